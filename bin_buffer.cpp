@@ -0,0 +1,217 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "bin_buffer.h"
+
+bin_buffer::bin_buffer()
+:
+heap_{},
+data_{nullptr},
+mapped_{nullptr},
+size_{0},
+capacity_{0},
+written_{0},
+fd_{-1},
+budget_{0},
+spill_dir_{}
+{
+}
+
+bin_buffer::~bin_buffer()
+{
+	unspill();
+}
+
+void
+bin_buffer::set_spill(std::size_t budget, std::string const& spill_dir)
+{
+	budget_ = budget;
+	spill_dir_ = spill_dir;
+	if (!is_spilled() && budget_ > 0 && size_ * sizeof (std::uint32_t) > budget_)
+	{
+		spill(size_);
+	}
+}
+
+void
+bin_buffer::resize(std::size_t count)
+{
+	if (!is_spilled())
+	{
+		if (budget_ > 0 && count * sizeof (std::uint32_t) > budget_ 
+			&& spill(std::max(count, 2 * size_)))
+		{
+			resize(count);
+			return;
+		}
+		if (budget_ > 0 && count > heap_.capacity())
+		{
+			/* the vector's own growth could overshoot the budget */
+			heap_.reserve(std::max(count, std::min(2 * heap_.capacity(), 
+												   budget_ / sizeof (std::uint32_t))));
+		}
+		heap_.resize(count, 0);
+		data_ = heap_.data();
+		size_ = count;
+		return;
+	}
+
+	if (count == 0)
+	{
+		unspill();
+		heap_.clear();
+		data_ = heap_.data();
+		size_ = 0;
+		return;
+	}
+
+	if (count > capacity_ && !grow_mapping(std::max(count, 2 * capacity_)))
+	{
+		throw std::bad_alloc();
+	}
+
+	/*
+	 * the file starts out zero, so only elements that were written before
+	 * a shrink need clearing
+	 */
+	if (count > size_ && written_ > size_)
+	{
+		std::fill(data_ + size_, data_ + std::min(count, written_), 0u);
+	}
+	size_ = count;
+	written_ = std::max(written_, count);
+}
+
+void
+bin_buffer::release(std::size_t first, std::size_t last)
+{
+	if (!is_spilled())
+	{
+		return;
+	}
+	std::uintptr_t page = static_cast<std::uintptr_t> (sysconf(_SC_PAGESIZE));
+	std::uintptr_t begin = reinterpret_cast<std::uintptr_t> (data_ + first);
+	std::uintptr_t end = reinterpret_cast<std::uintptr_t> (data_ + std::min(last, size_));
+	begin = (begin + page - 1) & ~(page - 1);
+	end &= ~(page - 1);
+	if (begin < end)
+	{
+		madvise(reinterpret_cast<void*> (begin), end - begin, MADV_DONTNEED);
+	}
+}
+
+bool
+bin_buffer::spill(std::size_t capacity)
+{
+	capacity = std::max<std::size_t> (capacity, 1);
+	std::string name_template = spill_dir_ + "/imgmatch-XXXXXX";
+	std::vector<char> name(name_template.begin(), name_template.end());
+	name.push_back('\0');
+
+	fd_ = mkstemp(name.data());
+	if (fd_ >= 0)
+	{
+		/* nothing else needs the name, and the file goes away with us */
+		unlink(name.data());
+		if (ftruncate(fd_, capacity * sizeof (std::uint32_t)) == 0)
+		{
+			void* p = mmap(nullptr, capacity * sizeof (std::uint32_t), 
+						   PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+			if (p != MAP_FAILED)
+			{
+				mapped_ = static_cast<std::uint32_t*> (p);
+			}
+		}
+	}
+	if (!mapped_)
+	{
+		std::cerr << "warning: could not spill histograms to " << spill_dir_ 
+				<< ": " << std::strerror(errno) << ", keeping them in memory" 
+				<< std::endl;
+		if (fd_ >= 0)
+		{
+			close(fd_);
+			fd_ = -1;
+		}
+		budget_ = 0;
+		return false;
+	}
+
+	std::copy(heap_.begin(), heap_.begin() + size_, mapped_);
+	bin_vector().swap(heap_);
+	data_ = mapped_;
+	capacity_ = capacity;
+	written_ = size_;
+	return true;
+}
+
+bool
+bin_buffer::grow_mapping(std::size_t capacity)
+{
+	/*
+	 * the contents live in the file, so the old mapping can simply be 
+	 * replaced with a bigger one, once the bigger one exists
+	 */
+	if (ftruncate(fd_, capacity * sizeof (std::uint32_t)) != 0)
+	{
+		std::cerr << "error: could not grow histogram spill file: " 
+				<< std::strerror(errno) << std::endl;
+		return false;
+	}
+	void* p = mmap(nullptr, capacity * sizeof (std::uint32_t), 
+				   PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (p == MAP_FAILED)
+	{
+		std::cerr << "error: could not map histogram spill file: " 
+				<< std::strerror(errno) << std::endl;
+		return false;
+	}
+	munmap(mapped_, capacity_ * sizeof (std::uint32_t));
+	mapped_ = static_cast<std::uint32_t*> (p);
+	data_ = mapped_;
+	capacity_ = capacity;
+	return true;
+}
+
+void
+bin_buffer::unspill()
+{
+	if (mapped_)
+	{
+		munmap(mapped_, capacity_ * sizeof (std::uint32_t));
+		mapped_ = nullptr;
+	}
+	if (fd_ >= 0)
+	{
+		close(fd_);
+		fd_ = -1;
+	}
+	capacity_ = 0;
+	written_ = 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef BIN_BUFFER_H
+#define BIN_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * Allocates storage aligned to cache lines, so that every row of a matrix
+ * whose row size is a multiple of the line size starts on a line.
+ */
+template <class T, std::size_t Alignment = 64>
+struct aligned_allocator
+{
+	using value_type = T;
+
+	template <class U>
+	struct rebind
+	{
+		using other = aligned_allocator<U, Alignment>;
+	};
+
+	aligned_allocator() = default;
+
+	template <class U>
+	aligned_allocator(aligned_allocator<U, Alignment> const&)
+	{
+	}
+
+	T*
+	allocate(std::size_t n)
+	{
+		void* p = nullptr;
+		if (posix_memalign(&p, Alignment, n * sizeof (T)) != 0)
+		{
+			throw std::bad_alloc();
+		}
+		return static_cast<T*> (p);
+	}
+
+	void
+	deallocate(T* p, std::size_t)
+	{
+		std::free(p);
+	}
+
+	template <class U>
+	bool operator==(aligned_allocator<U, Alignment> const&) const
+	{
+		return true;
+	}
+
+	template <class U>
+	bool operator!=(aligned_allocator<U, Alignment> const&) const
+	{
+		return false;
+	}
+};
+
+/*
+ * The bins of a matrix of histograms. The bins are held in memory until 
+ * they would need more than a budget of bytes; then they're moved to an
+ * unlinked temporary file, which is mapped and grown in place, so the 
+ * kernel can page rows out rather than the process running out of memory.
+ * Elements added by resizing are zero.
+ */
+class bin_buffer
+{
+public:
+
+	bin_buffer();
+
+	~bin_buffer();
+
+	bin_buffer(bin_buffer const&) = delete;
+	bin_buffer& operator=(bin_buffer const&) = delete;
+
+	void set_spill(std::size_t budget, std::string const& spill_dir);
+
+	void resize(std::size_t count);
+
+	/*
+	 * Drops the pages holding elements [first, last) from memory; they're
+	 * read back from the file when next used. Does nothing unless spilled.
+	 */
+	void release(std::size_t first, std::size_t last);
+
+	inline bool
+	is_spilled() const
+	{
+		return mapped_ != nullptr;
+	}
+
+	inline std::size_t
+	size() const
+	{
+		return size_;
+	}
+
+	inline std::uint32_t&
+	operator[](std::size_t index)
+	{
+		return data_[index];
+	}
+
+	inline std::uint32_t const&
+	operator[](std::size_t index) const
+	{
+		return data_[index];
+	}
+
+private:
+
+	using bin_vector = std::vector<std::uint32_t, aligned_allocator<std::uint32_t>>;
+
+	bool spill(std::size_t capacity);
+
+	bool grow_mapping(std::size_t capacity);
+
+	void unspill();
+
+	bin_vector heap_;
+	std::uint32_t* data_;
+	std::uint32_t* mapped_;
+	std::size_t size_;
+	std::size_t capacity_;
+	std::size_t written_;
+	int fd_;
+	std::size_t budget_;
+	std::string spill_dir_;
+};
+
+#endif /* BIN_BUFFER_H */
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "content_hash.h"
+
+namespace
+{
+
+constexpr std::uint64_t prime_1 = 11400714785074694791ull;
+constexpr std::uint64_t prime_2 = 14029467366897019727ull;
+constexpr std::uint64_t prime_3 = 1609587929392839161ull;
+constexpr std::uint64_t prime_4 = 9650029242287828579ull;
+constexpr std::uint64_t prime_5 = 2870177450012600261ull;
+
+constexpr std::size_t prefix_length = 4096;
+constexpr std::size_t read_block_size = 1 << 16;
+
+inline std::uint64_t
+rotl(std::uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+inline std::uint64_t
+read64(unsigned char const* p)
+{
+	std::uint64_t v;
+	std::memcpy(&v, p, sizeof (v));
+	return v;
+}
+
+inline std::uint32_t
+read32(unsigned char const* p)
+{
+	std::uint32_t v;
+	std::memcpy(&v, p, sizeof (v));
+	return v;
+}
+
+inline std::uint64_t
+hash_round(std::uint64_t acc, std::uint64_t input)
+{
+	acc += input * prime_2;
+	acc = rotl(acc, 31);
+	return acc * prime_1;
+}
+
+inline std::uint64_t
+merge_round(std::uint64_t acc, std::uint64_t value)
+{
+	acc ^= hash_round(0, value);
+	return acc * prime_1 + prime_4;
+}
+
+} // namespace
+
+content_hasher::content_hasher(std::uint64_t seed)
+:
+acc_{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1},
+seed_{seed},
+total_length_{0},
+buffered_{0}
+{
+}
+
+void
+content_hasher::update(void const* data, std::size_t length)
+{
+	auto p = static_cast<unsigned char const*> (data);
+	auto end = p + length;
+	total_length_ += length;
+
+	if (buffered_ + length < sizeof (buffer_))
+	{
+		std::memcpy(buffer_ + buffered_, p, length);
+		buffered_ += length;
+		return;
+	}
+
+	if (buffered_ > 0)
+	{
+		std::size_t fill = sizeof (buffer_) - buffered_;
+		std::memcpy(buffer_ + buffered_, p, fill);
+		p += fill;
+		for (auto i = 0; i < 4; ++i)
+		{
+			acc_[i] = hash_round(acc_[i], read64(buffer_ + i * 8));
+		}
+		buffered_ = 0;
+	}
+
+	while (p + 32 <= end)
+	{
+		for (auto i = 0; i < 4; ++i)
+		{
+			acc_[i] = hash_round(acc_[i], read64(p + i * 8));
+		}
+		p += 32;
+	}
+
+	buffered_ = end - p;
+	std::memcpy(buffer_, p, buffered_);
+}
+
+std::uint64_t
+content_hasher::digest() const
+{
+	std::uint64_t h;
+
+	if (total_length_ >= 32)
+	{
+		h = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) 
+				+ rotl(acc_[3], 18);
+		for (auto i = 0; i < 4; ++i)
+		{
+			h = merge_round(h, acc_[i]);
+		}
+	}
+	else
+	{
+		h = seed_ + prime_5;
+	}
+
+	h += total_length_;
+
+	unsigned char const* p = buffer_;
+	unsigned char const* end = buffer_ + buffered_;
+
+	while (p + 8 <= end)
+	{
+		h ^= hash_round(0, read64(p));
+		h = rotl(h, 27) * prime_1 + prime_4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= static_cast<std::uint64_t> (read32(p)) * prime_1;
+		h = rotl(h, 23) * prime_2 + prime_3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h ^= (*p) * prime_5;
+		h = rotl(h, 11) * prime_1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= prime_2;
+	h ^= h >> 29;
+	h *= prime_3;
+	h ^= h >> 32;
+	return h;
+}
+
+std::uint64_t 
+hash_bytes(void const* data, std::size_t length, std::uint64_t seed)
+{
+	content_hasher hasher(seed);
+	hasher.update(data, length);
+	return hasher.digest();
+}
+
+bool
+hash_file_prefix(std::string const& filename,
+				 std::uint64_t& size,
+				 std::uint64_t& hash)
+{
+	FILE* infile = fopen(filename.c_str(), "rb");
+	if (infile == NULL)
+	{
+		return false;
+	}
+
+	unsigned char buffer[prefix_length];
+	std::size_t count = fread(buffer, 1, sizeof (buffer), infile);
+	bool result = !ferror(infile);
+	if (result)
+	{
+		if (count < sizeof (buffer))
+		{
+			size = count;
+		}
+		else
+		{
+			result = fseek(infile, 0, SEEK_END) == 0;
+			long end = ftell(infile);
+			result = result && end >= 0;
+			size = static_cast<std::uint64_t> (end);
+		}
+		hash = hash_bytes(buffer, count, size);
+	}
+	fclose(infile);
+	return result;
+}
+
+bool
+hash_file(std::string const& filename, std::uint64_t& hash)
+{
+	FILE* infile = fopen(filename.c_str(), "rb");
+	if (infile == NULL)
+	{
+		return false;
+	}
+
+	content_hasher hasher;
+	std::vector<unsigned char> buffer(read_block_size);
+	std::size_t count;
+	while ((count = fread(buffer.data(), 1, buffer.size(), infile)) > 0)
+	{
+		hasher.update(buffer.data(), count);
+	}
+	bool result = !ferror(infile);
+	fclose(infile);
+	hash = hasher.digest();
+	return result;
+}
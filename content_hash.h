@@ -0,0 +1,69 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Fast non-cryptographic 64-bit hash of file contents (the XXH64 algorithm),
+ * used to find byte-identical files without decoding them.
+ */
+
+class content_hasher
+{
+public:
+
+	explicit content_hasher(std::uint64_t seed = 0);
+
+	void update(void const* data, std::size_t length);
+
+	std::uint64_t digest() const;
+
+private:
+
+	std::uint64_t acc_[4];
+	std::uint64_t seed_;
+	std::uint64_t total_length_;
+	unsigned char buffer_[32];
+	std::size_t buffered_;
+};
+
+std::uint64_t hash_bytes(void const* data, std::size_t length, 
+						 std::uint64_t seed = 0);
+
+/*
+ * Gets the size of a file and the hash of (at most) its first 
+ * prefix_length bytes. This is cheap, and distinguishes most files 
+ * that aren't identical.
+ */
+bool hash_file_prefix(std::string const& filename,
+					  std::uint64_t& size,
+					  std::uint64_t& hash);
+
+bool hash_file(std::string const& filename, std::uint64_t& hash);
+
+#endif /* CONTENT_HASH_H */
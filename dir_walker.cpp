@@ -0,0 +1,348 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boost/filesystem/operations.hpp"
+#include "dir_walker.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+
+/* directories waiting to be read hold at most this many descriptors */
+constexpr std::size_t max_open_dirs = 256;
+
+constexpr std::size_t dirent_buffer_size = 64 * 1024;
+
+/* the walk mostly waits on the filesystem, so cores aren't the limit */
+constexpr unsigned min_walk_threads = 4;
+
+constexpr int dir_open_flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+
+std::mutex error_mutex;
+
+void
+report_error(std::string const& what, std::string const& where, int error)
+{
+	std::lock_guard<std::mutex> lock(error_mutex);
+	std::cerr << "error: " << what << " " << where 
+			<< ", error code message: " << std::strerror(error) << std::endl;
+}
+
+#ifdef __linux__
+
+struct linux_dirent64
+{
+	ino64_t d_ino;
+	off64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+
+/*
+ * Calls visit(name, type) for each entry of the open directory fd, other 
+ * than "." and "..", reading the entries in large batches. Returns 0, or 
+ * the error that stopped the read.
+ */
+template <class Visit>
+int
+for_each_entry(int fd, Visit visit)
+{
+	std::unique_ptr<char[]> buffer(new char[dirent_buffer_size]);
+	while (true)
+	{
+		long count = ::syscall(SYS_getdents64, fd, buffer.get(), 
+							   dirent_buffer_size);
+		if (count < 0)
+		{
+			return errno;
+		}
+		if (count == 0)
+		{
+			return 0;
+		}
+		for (long offset = 0; offset < count;)
+		{
+			auto entry = reinterpret_cast<linux_dirent64 const*> 
+					(buffer.get() + offset);
+			offset += entry->d_reclen;
+			char const* name = entry->d_name;
+			if (std::strcmp(name, ".") != 0 && std::strcmp(name, "..") != 0)
+			{
+				visit(name, entry->d_type);
+			}
+		}
+	}
+}
+
+#else
+
+template <class Visit>
+int
+for_each_entry(int fd, Visit visit)
+{
+	int dir_fd = ::dup(fd);
+	DIR* dir = dir_fd < 0 ? nullptr : ::fdopendir(dir_fd);
+	if (!dir)
+	{
+		int error = errno;
+		if (dir_fd >= 0)
+		{
+			::close(dir_fd);
+		}
+		return error;
+	}
+	errno = 0;
+	while (dirent* entry = ::readdir(dir))
+	{
+		char const* name = entry->d_name;
+		if (std::strcmp(name, ".") != 0 && std::strcmp(name, "..") != 0)
+		{
+			visit(name, entry->d_type);
+		}
+	}
+	int error = errno;
+	::closedir(dir);
+	return error;
+}
+
+#endif /* __linux__ */
+
+unsigned char
+stat_type(int dir_fd, char const* name)
+{
+	struct stat st;
+	if (::fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+	{
+		return DT_UNKNOWN;
+	}
+	if (S_ISDIR(st.st_mode))
+	{
+		return DT_DIR;
+	}
+	if (S_ISREG(st.st_mode))
+	{
+		return DT_REG;
+	}
+	if (S_ISLNK(st.st_mode))
+	{
+		return DT_LNK;
+	}
+	return DT_UNKNOWN;
+}
+
+} // namespace
+
+dir_walker::dir_walker(filter accept, std::size_t thread_count)
+:
+accept_{std::move(accept)},
+thread_count_{thread_count > 0 ? thread_count 
+		: std::max(std::thread::hardware_concurrency(), min_walk_threads)},
+mutex_{},
+ready_{},
+pending_{},
+open_fds_{0},
+busy_{0}
+{
+}
+
+void
+dir_walker::walk(fs::path const& root, std::vector<fs::path>& files)
+{
+	std::string root_path;
+	try
+	{
+		root_path = fs::canonical(root).string();
+	}
+	catch (const std::exception & ex)
+	{
+		std::lock_guard<std::mutex> lock(error_mutex);
+		std::cerr << "error: '" << root << "' " << ex.what() << std::endl;
+		return;
+	}
+
+	pending_.push_back(pending_dir{-1, root_path});
+	open_fds_ = 0;
+	busy_ = 0;
+
+	std::vector<std::vector<std::string>> found(thread_count_);
+	std::vector<std::thread> threads;
+	for (auto i = 1ul; i < thread_count_; ++i)
+	{
+		threads.emplace_back([this, &found, i]() { work(found[i]); });
+	}
+	work(found[0]);
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	/* sorted, so that a tree is always searched in the same order */
+	std::vector<std::string> paths;
+	for (auto& thread_found : found)
+	{
+		paths.insert(paths.end(), 
+					 std::make_move_iterator(thread_found.begin()),
+					 std::make_move_iterator(thread_found.end()));
+	}
+	std::sort(paths.begin(), paths.end());
+	files.reserve(files.size() + paths.size());
+	for (auto& path : paths)
+	{
+		files.emplace_back(std::move(path));
+	}
+}
+
+void
+dir_walker::work(std::vector<std::string>& files)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		ready_.wait(lock, [this]() { return !pending_.empty() || busy_ == 0; });
+		if (pending_.empty())
+		{
+			return;
+		}
+		pending_dir dir = std::move(pending_.front());
+		pending_.pop_front();
+		if (dir.fd >= 0)
+		{
+			--open_fds_;
+		}
+		++busy_;
+		lock.unlock();
+		read_dir(dir, files);
+		lock.lock();
+		if (--busy_ == 0 && pending_.empty())
+		{
+			ready_.notify_all();
+		}
+	}
+}
+
+void
+dir_walker::read_dir(pending_dir const& dir, std::vector<std::string>& files)
+{
+	int fd = dir.fd >= 0 ? dir.fd : ::open(dir.path.c_str(), dir_open_flags);
+	if (fd < 0)
+	{
+		report_error("couldn't open directory", dir.path, errno);
+		return;
+	}
+
+	std::string base(dir.path == "/" ? std::string{} : dir.path);
+	std::vector<std::string> subdirs;
+	int error = for_each_entry(fd, [&](char const* name, unsigned char type)
+	{
+		if (type == DT_UNKNOWN)
+		{
+			/* some filesystems don't record types in their directories */
+			type = stat_type(fd, name);
+		}
+		if (type == DT_DIR)
+		{
+			subdirs.emplace_back(name);
+		}
+		else if ((type == DT_REG || type == DT_LNK) && accept_(name))
+		{
+			std::string path(base);
+			path.append("/").append(name);
+			if (type == DT_REG)
+			{
+				files.push_back(std::move(path));
+				return;
+			}
+			struct stat st;
+			if (::fstatat(fd, name, &st, 0) == 0 && S_ISREG(st.st_mode))
+			{
+				try
+				{
+					files.push_back(fs::canonical(path).string());
+				}
+				catch (const std::exception & ex)
+				{
+					std::lock_guard<std::mutex> lock(error_mutex);
+					std::cerr << "error: '" << name << "' " << ex.what() 
+							<< std::endl;
+				}
+			}
+		}
+	});
+	if (error != 0)
+	{
+		report_error("couldn't read directory", dir.path, error);
+	}
+
+	for (auto const& name : subdirs)
+	{
+		push(fd, name, base + "/" + name);
+	}
+	::close(fd);
+}
+
+void
+dir_walker::push(int parent_fd, std::string const& name, std::string path)
+{
+	bool may_open;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		may_open = open_fds_ < max_open_dirs;
+		if (may_open)
+		{
+			++open_fds_;
+		}
+	}
+
+	/*
+	 * while few directories are waiting, they're opened relative to their
+	 * parent, which is already open; beyond that they're left to be opened
+	 * by path, so a wide tree can't run out of descriptors
+	 */
+	int fd = -1;
+	if (may_open)
+	{
+		fd = ::openat(parent_fd, name.c_str(), dir_open_flags);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (may_open && fd < 0)
+	{
+		--open_fds_;
+	}
+	pending_.push_back(pending_dir{fd, std::move(path)});
+	ready_.notify_one();
+}
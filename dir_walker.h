@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef DIR_WALKER_H
+#define DIR_WALKER_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Finds the files in a directory tree whose names pass a filter, reading 
+ * several directories at once. Only the root is canonicalized; the paths 
+ * of everything below it are built from the root and the names read from 
+ * each directory, and the type of each entry comes from the directory 
+ * itself, so most files cost no system calls of their own. Subdirectories
+ * are opened relative to their parent's descriptor. Symbolic links to files 
+ * are resolved, as in a search of a single directory; symbolic links to 
+ * directories aren't followed, so a tree can't contain itself.
+ */
+class dir_walker
+{
+public:
+
+	using filter = std::function<bool (std::string const&)>;
+
+	dir_walker(filter accept, std::size_t thread_count = 0);
+
+	/*
+	 * Appends the paths of the accepted files under root to files, in
+	 * sorted order. Directories that can't be read are reported and 
+	 * skipped.
+	 */
+	void walk(fs::path const& root, std::vector<fs::path>& files);
+
+private:
+
+	struct pending_dir
+	{
+		int fd;
+		std::string path;
+	};
+
+	void work(std::vector<std::string>& files);
+
+	void read_dir(pending_dir const& dir, std::vector<std::string>& files);
+
+	void push(int parent_fd, std::string const& name, std::string path);
+
+	filter accept_;
+	std::size_t thread_count_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::deque<pending_dir> pending_;
+	std::size_t open_fds_;
+	std::size_t busy_;
+};
+
+#endif /* DIR_WALKER_H */
@@ -0,0 +1,257 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+#include "dir_watcher.h"
+
+#ifdef __linux__
+
+#include <csignal>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace
+{
+
+volatile std::sig_atomic_t stop_requested = 0;
+sigset_t wait_mask;
+
+void
+request_stop(int)
+{
+	stop_requested = 1;
+}
+
+} // namespace
+
+dir_watcher::dir_watcher()
+:
+fd_{-1},
+watches_{},
+dirs_{},
+signals_blocked_{false}
+{
+}
+
+dir_watcher::~dir_watcher()
+{
+	if (fd_ >= 0)
+	{
+		::close(fd_);
+	}
+	if (signals_blocked_)
+	{
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		sigset_t blocked;
+		sigemptyset(&blocked);
+		sigaddset(&blocked, SIGINT);
+		sigaddset(&blocked, SIGTERM);
+		sigprocmask(SIG_UNBLOCK, &blocked, nullptr);
+	}
+}
+
+bool
+dir_watcher::open(std::vector<fs::path> const& dirs)
+{
+	fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd_ < 0)
+	{
+		std::cerr << "error: could not start watching: " 
+				<< std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	dirs_ = dirs;
+	for (auto const& dir : dirs_)
+	{
+		int wd = inotify_add_watch(fd_, dir.c_str(), 
+								   IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+		if (wd < 0)
+		{
+			std::cerr << "error: could not watch " << dir << ": " 
+					<< std::strerror(errno) << std::endl;
+			return false;
+		}
+		watches_.push_back(wd);
+	}
+
+	/*
+	 * block the signals everywhere but in ppoll, so a signal arriving
+	 * between checking for it and waiting can't be missed
+	 */
+	struct sigaction action;
+	std::memset(&action, 0, sizeof (action));
+	action.sa_handler = request_stop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	sigset_t blocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	sigprocmask(SIG_BLOCK, &blocked, &wait_mask);
+	sigdelset(&wait_mask, SIGINT);
+	sigdelset(&wait_mask, SIGTERM);
+	signals_blocked_ = true;
+	return true;
+}
+
+bool
+dir_watcher::wait(std::vector<watch_event>& events, 
+				  bool& rescan,
+				  int quiet_ms, 
+				  int max_ms)
+{
+	using clock = std::chrono::steady_clock;
+
+	events.clear();
+	rescan = false;
+	std::unordered_set<std::string> seen;
+	clock::time_point first;
+	alignas(inotify_event) char buffer[64 * 1024];
+
+	while (!stop_requested)
+	{
+		bool collecting = rescan || !events.empty();
+		struct timespec timeout;
+		struct timespec* timeout_ptr = nullptr;
+		if (collecting)
+		{
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds> (
+					clock::now() - first).count();
+			if (elapsed >= max_ms)
+			{
+				return true;
+			}
+			long wait_ms = std::min<long> (quiet_ms, max_ms - elapsed);
+			timeout.tv_sec = wait_ms / 1000;
+			timeout.tv_nsec = (wait_ms % 1000) * 1000000;
+			timeout_ptr = &timeout;
+		}
+
+		struct pollfd pfd{fd_, POLLIN, 0};
+		int ready = ppoll(&pfd, 1, timeout_ptr, &wait_mask);
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			std::cerr << "error: watching failed: " << std::strerror(errno) 
+					<< std::endl;
+			return false;
+		}
+		if (ready == 0)
+		{
+			/* quiet for long enough */
+			return true;
+		}
+
+		ssize_t length;
+		while ((length = ::read(fd_, buffer, sizeof (buffer))) > 0)
+		{
+			for (char* p = buffer; p < buffer + length; )
+			{
+				auto event = reinterpret_cast<inotify_event const*> (p);
+				p += sizeof (inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					rescan = true;
+				}
+				else if (event->mask & IN_IGNORED)
+				{
+					std::cerr << "warning: a watched directory was removed" 
+							<< std::endl;
+				}
+				else if (event->len > 0 && !(event->mask & IN_ISDIR))
+				{
+					auto it = std::find(watches_.begin(), watches_.end(), 
+										event->wd);
+					if (it == watches_.end())
+					{
+						continue;
+					}
+					std::size_t dir = it - watches_.begin();
+					fs::path path = dirs_[dir] / event->name;
+					if (seen.insert(path.string()).second)
+					{
+						events.push_back(watch_event{dir, path});
+					}
+				}
+			}
+		}
+		if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			std::cerr << "error: watching failed: " << std::strerror(errno) 
+					<< std::endl;
+			return false;
+		}
+		if (!collecting && (rescan || !events.empty()))
+		{
+			first = clock::now();
+		}
+	}
+	return false;
+}
+
+#else
+
+dir_watcher::dir_watcher()
+:
+fd_{-1},
+watches_{},
+dirs_{},
+signals_blocked_{false}
+{
+}
+
+dir_watcher::~dir_watcher()
+{
+}
+
+bool
+dir_watcher::open(std::vector<fs::path> const&)
+{
+	std::cerr << "error: watching directories requires inotify, which isn't"
+			<< " available on this platform" << std::endl;
+	return false;
+}
+
+bool
+dir_watcher::wait(std::vector<watch_event>& events, bool& rescan, int, int)
+{
+	events.clear();
+	rescan = false;
+	return false;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef DIR_WATCHER_H
+#define DIR_WATCHER_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <cstddef>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+
+namespace fs = boost::filesystem;
+
+struct watch_event
+{
+	std::size_t dir;
+	fs::path path;
+};
+
+/*
+ * Waits for image files to land in a set of directories, using inotify. A
+ * file is reported once it has been closed after writing, or moved into a 
+ * directory, so files that are still being written aren't read. Events
+ * arriving in a burst are coalesced into a single batch, with each file 
+ * appearing once.
+ *
+ * While the watcher is open, SIGINT and SIGTERM are only delivered during
+ * a wait, which then returns false, so a batch is never cut short.
+ */
+class dir_watcher
+{
+public:
+
+	dir_watcher();
+
+	~dir_watcher();
+
+	dir_watcher(dir_watcher const&) = delete;
+	dir_watcher& operator=(dir_watcher const&) = delete;
+
+	bool open(std::vector<fs::path> const& dirs);
+
+	/*
+	 * Waits for a batch of files. Once the first one arrives, keeps 
+	 * collecting until no more have arrived for quiet_ms milliseconds, or
+	 * max_ms have passed. Sets rescan if events were lost, in which case 
+	 * the caller should look through the directories for itself. Returns
+	 * false when interrupted by a signal, or on error.
+	 */
+	bool wait(std::vector<watch_event>& events, 
+			  bool& rescan,
+			  int quiet_ms = 500, 
+			  int max_ms = 5000);
+
+private:
+
+	int fd_;
+	std::vector<int> watches_;
+	std::vector<fs::path> dirs_;
+	bool signals_blocked_;
+};
+
+#endif /* DIR_WATCHER_H */
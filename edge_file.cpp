@@ -0,0 +1,207 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <fstream>
+#include "edge_file.h"
+
+namespace
+{
+
+constexpr std::uint32_t edge_file_magic = 0x45444749; // "IGDE"
+constexpr std::uint32_t edge_file_version = 1;
+
+template <class T>
+inline void
+write_value(std::ostream& out, T const& value)
+{
+	out.write(reinterpret_cast<char const*> (&value), sizeof (value));
+}
+
+template <class T>
+inline bool
+read_value(std::istream& in, T& value)
+{
+	in.read(reinterpret_cast<char*> (&value), sizeof (value));
+	return static_cast<bool> (in);
+}
+
+/*
+ * the bytes left in the file, which bound the counts a corrupt header can
+ * claim
+ */
+std::uint64_t
+remaining(std::istream& in, std::uint64_t file_size)
+{
+	auto position = static_cast<std::uint64_t> (in.tellg());
+	return position < file_size ? file_size - position : 0;
+}
+
+} // namespace
+
+edge_file::edge_file()
+:
+shard_{0},
+shard_count_{0},
+threshold_{0.0},
+paths_{},
+path_index_{},
+edges_{}
+{
+}
+
+bool
+edge_file::load(std::string const& filename)
+{
+	std::ifstream in(filename, std::ios::binary | std::ios::ate);
+	if (!in)
+	{
+		return false;
+	}
+	auto file_size = static_cast<std::uint64_t> (in.tellg());
+	in.seekg(0);
+
+	std::uint32_t magic = 0;
+	std::uint32_t version = 0;
+	std::uint32_t shard = 0;
+	std::uint32_t shard_count = 0;
+	double threshold = 0.0;
+	std::uint64_t path_count = 0;
+	if (!read_value(in, magic) || !read_value(in, version) 
+		|| !read_value(in, shard) || !read_value(in, shard_count)
+		|| !read_value(in, threshold) || !read_value(in, path_count)
+		|| magic != edge_file_magic || version != edge_file_version
+		|| shard >= shard_count
+		|| path_count > remaining(in, file_size) / sizeof (std::uint32_t))
+	{
+		return false;
+	}
+
+	std::vector<std::string> paths(path_count);
+	for (auto& path : paths)
+	{
+		std::uint32_t length = 0;
+		if (!read_value(in, length) || length > remaining(in, file_size))
+		{
+			return false;
+		}
+		path.resize(length);
+		if (!in.read(&path[0], length))
+		{
+			return false;
+		}
+	}
+
+	std::uint64_t edge_count = 0;
+	if (!read_value(in, edge_count) 
+		|| edge_count > remaining(in, file_size) 
+				/ (2 * sizeof (std::uint32_t) + sizeof (double)))
+	{
+		return false;
+	}
+	std::vector<edge> edges(edge_count);
+	for (auto& e : edges)
+	{
+		if (!read_value(in, e.a) || !read_value(in, e.b) 
+			|| !read_value(in, e.distance) 
+			|| e.a >= path_count || e.b >= path_count)
+		{
+			return false;
+		}
+	}
+
+	shard_ = shard;
+	shard_count_ = shard_count;
+	threshold_ = threshold;
+	paths_ = std::move(paths);
+	path_index_.clear();
+	edges_ = std::move(edges);
+	return true;
+}
+
+bool
+edge_file::save(std::string const& filename) const
+{
+	std::string temp_filename(filename);
+	temp_filename.append(".tmp");
+	{
+		std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		write_value(out, edge_file_magic);
+		write_value(out, edge_file_version);
+		write_value(out, static_cast<std::uint32_t> (shard_));
+		write_value(out, static_cast<std::uint32_t> (shard_count_));
+		write_value(out, threshold_);
+		write_value(out, static_cast<std::uint64_t> (paths_.size()));
+		for (auto const& path : paths_)
+		{
+			write_value(out, static_cast<std::uint32_t> (path.size()));
+			out.write(path.data(), path.size());
+		}
+		write_value(out, static_cast<std::uint64_t> (edges_.size()));
+		for (auto const& e : edges_)
+		{
+			write_value(out, e.a);
+			write_value(out, e.b);
+			write_value(out, e.distance);
+		}
+		if (!out)
+		{
+			return false;
+		}
+	}
+	return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+void
+edge_file::set_shard(std::size_t shard, std::size_t shard_count)
+{
+	shard_ = shard;
+	shard_count_ = shard_count;
+}
+
+void
+edge_file::set_threshold(double threshold)
+{
+	threshold_ = threshold;
+}
+
+std::uint32_t
+edge_file::add_path(std::string const& path)
+{
+	auto found = path_index_.emplace(path, static_cast<std::uint32_t> (paths_.size()));
+	if (found.second)
+	{
+		paths_.push_back(path);
+	}
+	return found.first->second;
+}
+
+void
+edge_file::add_edge(std::uint32_t a, std::uint32_t b, double distance)
+{
+	edges_.push_back(edge{a, b, distance});
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef EDGE_FILE_H
+#define EDGE_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * The matches found by one shard of a sharded search: the paths of the 
+ * images that matched something, and the matching pairs, as indexes into
+ * the paths. Along with them go the shard's number, the number of shards,
+ * and the match threshold, so a merge can check that it has every shard
+ * and knows which distances are complete.
+ */
+class edge_file
+{
+public:
+
+	struct edge
+	{
+		std::uint32_t a;
+		std::uint32_t b;
+		double distance;
+	};
+
+	edge_file();
+
+	bool load(std::string const& filename);
+
+	bool save(std::string const& filename) const;
+
+	void set_shard(std::size_t shard, std::size_t shard_count);
+
+	void set_threshold(double threshold);
+
+	/*
+	 * Returns the index of path, adding it if it isn't already present.
+	 */
+	std::uint32_t add_path(std::string const& path);
+
+	void add_edge(std::uint32_t a, std::uint32_t b, double distance);
+
+	inline std::size_t
+	shard() const
+	{
+		return shard_;
+	}
+
+	inline std::size_t
+	shard_count() const
+	{
+		return shard_count_;
+	}
+
+	inline double
+	threshold() const
+	{
+		return threshold_;
+	}
+
+	inline std::vector<std::string> const&
+	paths() const
+	{
+		return paths_;
+	}
+
+	inline std::vector<edge> const&
+	edges() const
+	{
+		return edges_;
+	}
+
+private:
+
+	std::size_t shard_;
+	std::size_t shard_count_;
+	double threshold_;
+	std::vector<std::string> paths_;
+	std::unordered_map<std::string, std::uint32_t> path_index_;
+	std::vector<edge> edges_;
+};
+
+#endif /* EDGE_FILE_H */
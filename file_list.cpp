@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include "file_list.h"
+
+file_list_reader::file_list_reader(std::istream& in)
+:
+in_{in},
+separator_{'\n'},
+separator_known_{false}
+{
+}
+
+bool
+file_list_reader::next(std::string& entry)
+{
+	do
+	{
+		if (!read_entry(entry))
+		{
+			return false;
+		}
+		/* lists written on windows end their lines with \r\n */
+		if (separator_ == '\n' && !entry.empty() && entry.back() == '\r')
+		{
+			entry.pop_back();
+		}
+	}
+	while (entry.empty());
+	return true;
+}
+
+bool
+file_list_reader::read_entry(std::string& entry)
+{
+	if (separator_known_)
+	{
+		return static_cast<bool> (std::getline(in_, entry, separator_));
+	}
+	entry.clear();
+	while (true)
+	{
+		int c = in_.get();
+		if (c == std::char_traits<char>::eof())
+		{
+			return !entry.empty();
+		}
+		if (c == '\n' || c == '\0')
+		{
+			separator_ = static_cast<char> (c);
+			separator_known_ = true;
+			return true;
+		}
+		entry.push_back(static_cast<char> (c));
+	}
+}
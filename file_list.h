@@ -0,0 +1,56 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef FILE_LIST_H
+#define FILE_LIST_H
+
+#include <istream>
+#include <string>
+
+/*
+ * Reads the entries of a list of file names one at a time, so a list of any
+ * length can be worked through as it arrives. Entries are separated either
+ * by newlines or by NUL characters (as written by find -print0); whichever
+ * appears first is taken to be the separator for the rest of the list.
+ * Empty entries are skipped.
+ */
+class file_list_reader
+{
+public:
+
+	explicit file_list_reader(std::istream& in);
+
+	/*
+	 * Returns false at the end of the list.
+	 */
+	bool next(std::string& entry);
+
+private:
+
+	bool read_entry(std::string& entry);
+
+	std::istream& in_;
+	char separator_;
+	bool separator_known_;
+};
+
+#endif /* FILE_LIST_H */
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file_order.h"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace
+{
+
+struct file_key
+{
+	int tier;
+	std::uint64_t dev;
+	std::uint64_t location;
+	std::size_t index;
+};
+
+/*
+ * Finds the byte offset on its device of the first block of an open file.
+ */
+bool
+physical_location(int fd, std::uint64_t& location)
+{
+#ifdef __linux__
+	/* room for one extent after the header */
+	alignas(fiemap) char buffer[sizeof (fiemap) + sizeof (fiemap_extent)];
+	std::memset(buffer, 0, sizeof (buffer));
+	auto map = reinterpret_cast<fiemap*> (buffer);
+	map->fm_start = 0;
+	map->fm_length = FIEMAP_MAX_OFFSET;
+	map->fm_extent_count = 1;
+	if (::ioctl(fd, FS_IOC_FIEMAP, map) != 0 
+		|| map->fm_mapped_extents == 0
+		|| (map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN))
+	{
+		return false;
+	}
+	location = map->fm_extents[0].fe_physical;
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // namespace
+
+bool
+parse_file_order(std::string const& name, file_order& order)
+{
+	if (name == "listed")
+	{
+		order = file_order::listed;
+	}
+	else if (name == "inode")
+	{
+		order = file_order::inode;
+	}
+	else if (name == "physical")
+	{
+		order = file_order::physical;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+std::size_t
+order_files(std::vector<fs::path>& files, file_order order)
+{
+	if (order == file_order::listed)
+	{
+		return 0;
+	}
+
+	std::size_t located = 0;
+	std::vector<file_key> keys;
+	keys.reserve(files.size());
+	for (auto i = 0ul; i < files.size(); ++i)
+	{
+		file_key key{2, 0, 0, i};
+		struct stat st;
+		int fd = order == file_order::physical 
+				? ::open(files[i].c_str(), O_RDONLY | O_CLOEXEC) : -1;
+		if (fd >= 0 ? ::fstat(fd, &st) == 0 : ::stat(files[i].c_str(), &st) == 0)
+		{
+			key = file_key{1, static_cast<std::uint64_t> (st.st_dev), 
+						   static_cast<std::uint64_t> (st.st_ino), i};
+			std::uint64_t location = 0;
+			if (fd >= 0 && physical_location(fd, location))
+			{
+				key.tier = 0;
+				key.location = location;
+				++located;
+			}
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+		keys.push_back(key);
+	}
+
+	std::sort(keys.begin(), keys.end(), [](file_key const& a, file_key const& b)
+	{
+		return std::tie(a.tier, a.dev, a.location, a.index) 
+				< std::tie(b.tier, b.dev, b.location, b.index);
+	});
+
+	std::vector<fs::path> ordered;
+	ordered.reserve(files.size());
+	for (auto const& key : keys)
+	{
+		ordered.push_back(std::move(files[key.index]));
+	}
+	files.swap(ordered);
+	return located;
+}
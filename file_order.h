@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef FILE_ORDER_H
+#define FILE_ORDER_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+
+namespace fs = boost::filesystem;
+
+enum class file_order
+{
+	listed,
+	inode,
+	physical
+};
+
+/*
+ * Accepts "listed", "inode" and "physical".
+ */
+bool parse_file_order(std::string const& name, file_order& order);
+
+/*
+ * Sorts files into the order in which they'll be quickest to read from a
+ * spinning disk. With inode order, files are sorted by device and inode 
+ * number, which most filesystems allocate near the file's data. With 
+ * physical order, they're sorted by device and the location of their first
+ * block, as reported by FIEMAP; files whose location can't be found follow,
+ * in inode order. Files that can't be examined at all go last, in their
+ * original order. Returns the number of files placed by physical location.
+ */
+std::size_t order_files(std::vector<fs::path>& files, file_order order);
+
+#endif /* FILE_ORDER_H */
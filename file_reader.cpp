@@ -0,0 +1,589 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "file_reader.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+
+/* the first read of a file whose size isn't known */
+constexpr std::size_t initial_read_size = 256 * 1024;
+
+std::size_t
+read_size(int fd)
+{
+	struct stat st;
+	if (::fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		/*
+		 * one spare byte, so that a read which fills the buffer means the
+		 * file has grown, and a short read means it's all been read
+		 */
+		return static_cast<std::size_t> (st.st_size) + 1;
+	}
+	return initial_read_size;
+}
+
+int
+read_whole_file(std::string const& path, std::vector<unsigned char>& data)
+{
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return errno;
+	}
+	data.resize(read_size(fd));
+	std::size_t filled = 0;
+	int error = 0;
+	while (true)
+	{
+		ssize_t count = ::pread(fd, data.data() + filled, data.size() - filled, 
+								filled);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			error = errno;
+			break;
+		}
+		filled += count;
+		if (count == 0 || filled < data.size())
+		{
+			break;
+		}
+		data.resize(2 * data.size());
+	}
+	::close(fd);
+	data.resize(error ? 0 : filled);
+	return error;
+}
+
+} // namespace
+
+#ifdef __linux__
+
+/*
+ * The rings shared with the kernel, set up with the raw system calls.
+ */
+struct file_reader::uring
+{
+	int fd = -1;
+	void* sq_ring = MAP_FAILED;
+	std::size_t sq_ring_size = 0;
+	void* cq_ring = MAP_FAILED;
+	std::size_t cq_ring_size = 0;
+	io_uring_sqe* sqes = static_cast<io_uring_sqe*> (MAP_FAILED);
+	std::size_t sqes_size = 0;
+	unsigned* sq_head = nullptr;
+	unsigned* sq_tail = nullptr;
+	unsigned sq_mask = 0;
+	unsigned* sq_array = nullptr;
+	unsigned* cq_head = nullptr;
+	unsigned* cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	io_uring_cqe* cqes = nullptr;
+	unsigned to_submit = 0;
+
+	~uring()
+	{
+		if (sqes != MAP_FAILED)
+		{
+			::munmap(sqes, sqes_size);
+		}
+		if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+		{
+			::munmap(cq_ring, cq_ring_size);
+		}
+		if (sq_ring != MAP_FAILED)
+		{
+			::munmap(sq_ring, sq_ring_size);
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+	}
+
+	bool
+	open(unsigned entries)
+	{
+		io_uring_params params;
+		std::memset(&params, 0, sizeof (params));
+		fd = static_cast<int> (::syscall(__NR_io_uring_setup, entries, &params));
+		if (fd < 0 || !supports(IORING_OP_OPENAT) || !supports(IORING_OP_READ))
+		{
+			return false;
+		}
+
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof (io_uring_cqe);
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if (single_mmap)
+		{
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		}
+		sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, 
+						 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sq_ring == MAP_FAILED)
+		{
+			return false;
+		}
+		cq_ring = single_mmap ? sq_ring 
+				: ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, 
+						 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED)
+		{
+			return false;
+		}
+		sqes_size = params.sq_entries * sizeof (io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*> (
+				::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, 
+					   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED)
+		{
+			return false;
+		}
+
+		char* sq = static_cast<char*> (sq_ring);
+		sq_head = reinterpret_cast<unsigned*> (sq + params.sq_off.head);
+		sq_tail = reinterpret_cast<unsigned*> (sq + params.sq_off.tail);
+		sq_mask = *reinterpret_cast<unsigned*> (sq + params.sq_off.ring_mask);
+		sq_array = reinterpret_cast<unsigned*> (sq + params.sq_off.array);
+		char* cq = static_cast<char*> (cq_ring);
+		cq_head = reinterpret_cast<unsigned*> (cq + params.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*> (cq + params.cq_off.tail);
+		cq_mask = *reinterpret_cast<unsigned*> (cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*> (cq + params.cq_off.cqes);
+		return true;
+	}
+
+	bool
+	supports(unsigned op)
+	{
+		constexpr unsigned op_count = 256;
+		std::vector<char> buffer(sizeof (io_uring_probe) 
+								 + op_count * sizeof (io_uring_probe_op));
+		auto probe = reinterpret_cast<io_uring_probe*> (buffer.data());
+		if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, 
+					  probe, op_count) < 0)
+		{
+			return false;
+		}
+		return op <= probe->last_op 
+				&& (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	/*
+	 * Every request has at most one operation in flight, and there are 
+	 * no more requests in flight than entries, so there's always room.
+	 */
+	io_uring_sqe*
+	get_sqe(void* user_data)
+	{
+		unsigned tail = *sq_tail;
+		unsigned index = tail & sq_mask;
+		io_uring_sqe* sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof (*sqe));
+		sqe->user_data = reinterpret_cast<std::uint64_t> (user_data);
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		++to_submit;
+		return sqe;
+	}
+
+	int
+	enter(unsigned wait_count)
+	{
+		while (true)
+		{
+			long submitted = ::syscall(__NR_io_uring_enter, fd, to_submit, 
+									   wait_count, 
+									   wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, 
+									   nullptr, 0);
+			if (submitted >= 0)
+			{
+				to_submit -= static_cast<unsigned> (submitted);
+				return 0;
+			}
+			if (errno != EINTR)
+			{
+				return errno;
+			}
+		}
+	}
+};
+
+void
+file_reader::uring_start(request& r)
+{
+	io_uring_sqe* sqe = ring_->get_sqe(&r);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = reinterpret_cast<std::uint64_t> (r.path.c_str());
+	sqe->open_flags = O_RDONLY | O_CLOEXEC;
+}
+
+void
+file_reader::uring_read(request& r)
+{
+	io_uring_sqe* sqe = ring_->get_sqe(&r);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = r.fd;
+	sqe->addr = reinterpret_cast<std::uint64_t> (r.data.data() + r.filled);
+	sqe->len = static_cast<std::uint32_t> (r.data.size() - r.filled);
+	sqe->off = r.filled;
+}
+
+void
+file_reader::uring_complete(request& r, int result)
+{
+	if (result == -EINTR || result == -EAGAIN)
+	{
+		if (r.fd < 0)
+		{
+			uring_start(r);
+		}
+		else
+		{
+			uring_read(r);
+		}
+		return;
+	}
+	if (result < 0)
+	{
+		uring_finish(r, -result);
+		return;
+	}
+	if (r.fd < 0)
+	{
+		r.fd = result;
+		r.data.resize(read_size(r.fd));
+		uring_read(r);
+		return;
+	}
+	r.filled += static_cast<std::size_t> (result);
+	if (result == 0 || r.filled < r.data.size())
+	{
+		uring_finish(r, 0);
+		return;
+	}
+	r.data.resize(2 * r.data.size());
+	uring_read(r);
+}
+
+void
+file_reader::uring_finish(request& r, int error)
+{
+	if (r.fd >= 0)
+	{
+		::close(r.fd);
+		r.fd = -1;
+	}
+	r.data.resize(error ? 0 : r.filled);
+	r.error = error;
+	r.done = true;
+	--in_flight_;
+	if (!waiting_.empty())
+	{
+		request* next = waiting_.front();
+		waiting_.pop_front();
+		++in_flight_;
+		uring_start(*next);
+	}
+}
+
+bool
+file_reader::uring_wait()
+{
+	int error = ring_->enter(1);
+	if (error != 0)
+	{
+		std::cerr << "error: io_uring_enter failed, error code message: " 
+				<< std::strerror(error) << std::endl;
+		return false;
+	}
+	unsigned head = *ring_->cq_head;
+	unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head)
+	{
+		io_uring_cqe const& cqe = ring_->cqes[head & ring_->cq_mask];
+		uring_complete(*reinterpret_cast<request*> (cqe.user_data), cqe.res);
+	}
+	__atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
+	return true;
+}
+
+#else
+
+struct file_reader::uring
+{
+	bool
+	open(unsigned)
+	{
+		return false;
+	}
+};
+
+void file_reader::uring_start(request&) {}
+void file_reader::uring_read(request&) {}
+void file_reader::uring_complete(request&, int) {}
+void file_reader::uring_finish(request&, int) {}
+bool file_reader::uring_wait() { return false; }
+
+#endif /* __linux__ */
+
+file_reader::file_reader()
+:
+method_{method::pread},
+depth_{0},
+requests_{},
+waiting_{},
+in_flight_{0},
+ring_{},
+mutex_{},
+ready_{},
+threads_{},
+stopping_{false}
+{
+}
+
+file_reader::~file_reader()
+{
+	if (method_ == method::uring)
+	{
+		/* the kernel may still be writing into the buffers */
+		while (in_flight_ > 0 && uring_wait())
+		{
+		}
+		release_in_flight();
+		for (auto& r : requests_)
+		{
+			if (r->fd >= 0)
+			{
+				::close(r->fd);
+			}
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	ready_.notify_all();
+	for (auto& t : threads_)
+	{
+		t.join();
+	}
+}
+
+file_reader::method
+file_reader::open(method requested, std::size_t depth)
+{
+	depth_ = std::max<std::size_t> (depth, 1);
+	if (requested == method::uring)
+	{
+		ring_.reset(new uring);
+		if (ring_->open(static_cast<unsigned> (depth_)))
+		{
+			method_ = method::uring;
+			return method_;
+		}
+		ring_.reset();
+		std::cerr << "warning: io_uring isn't available, reading files with pread"
+				<< std::endl;
+	}
+	method_ = method::pread;
+	for (auto i = 0ul; i < depth_; ++i)
+	{
+		threads_.emplace_back([this]() { pread_work(); });
+	}
+	return method_;
+}
+
+void
+file_reader::submit(std::string path)
+{
+	requests_.emplace_back(new request{std::move(path), {}, 0, -1, 0, false});
+	request* r = requests_.back().get();
+	if (method_ == method::uring)
+	{
+		if (in_flight_ < depth_)
+		{
+			++in_flight_;
+			uring_start(*r);
+			ring_->enter(0);
+		}
+		else
+		{
+			waiting_.push_back(r);
+		}
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		waiting_.push_back(r);
+	}
+	ready_.notify_all();
+}
+
+void
+file_reader::prefetch(std::string const& path)
+{
+#ifdef POSIX_FADV_WILLNEED
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		::close(fd);
+	}
+#endif
+}
+
+int
+file_reader::read(std::string const& path, std::vector<unsigned char>& data)
+{
+	return read_whole_file(path, data);
+}
+
+void
+file_reader::drop(std::string const& path)
+{
+#ifdef POSIX_FADV_DONTNEED
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd >= 0)
+	{
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+	}
+#endif
+}
+
+bool
+file_reader::next(std::vector<unsigned char>& data, int& error)
+{
+	if (requests_.empty())
+	{
+		return false;
+	}
+	if (method_ == method::uring)
+	{
+		while (!requests_.front()->done && uring_wait())
+		{
+		}
+		if (!requests_.front()->done)
+		{
+			abandon_ring();
+		}
+	}
+	request& r = *requests_.front();
+	if (method_ == method::pread)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		ready_.wait(lock, [&r]() { return r.done; });
+	}
+	data = std::move(r.data);
+	error = r.error;
+	requests_.pop_front();
+	return true;
+}
+
+void
+file_reader::release_in_flight()
+{
+	/*
+	 * Requests the kernel still holds can't be freed, or even have their 
+	 * files closed, since a completion may yet write to them. They're left
+	 * behind, and fresh requests for the same files take their places.
+	 */
+	for (auto& r : requests_)
+	{
+		if (r->done || std::find(waiting_.begin(), waiting_.end(), r.get()) 
+				!= waiting_.end())
+		{
+			continue;
+		}
+		std::string path = r->path;
+		r.release();
+		r.reset(new request{std::move(path), {}, 0, -1, 0, false});
+	}
+	in_flight_ = 0;
+}
+
+void
+file_reader::abandon_ring()
+{
+	std::cerr << "warning: giving up on io_uring, reading files with pread"
+			<< std::endl;
+	release_in_flight();
+	ring_.reset();
+	waiting_.clear();
+	for (auto& r : requests_)
+	{
+		if (!r->done)
+		{
+			waiting_.push_back(r.get());
+		}
+	}
+	method_ = method::pread;
+	for (auto i = 0ul; i < depth_; ++i)
+	{
+		threads_.emplace_back([this]() { pread_work(); });
+	}
+}
+
+void
+file_reader::pread_work()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		ready_.wait(lock, [this]() { return stopping_ || !waiting_.empty(); });
+		if (stopping_)
+		{
+			return;
+		}
+		request* r = waiting_.front();
+		waiting_.pop_front();
+		lock.unlock();
+		r->error = read_whole_file(r->path, r->data);
+		lock.lock();
+		r->done = true;
+		ready_.notify_all();
+	}
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef FILE_READER_H
+#define FILE_READER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Reads whole files ahead of when they're needed, keeping up to depth files
+ * open and being read at once, and hands them back in the order they were
+ * submitted. On Linux, the opens and reads can be issued through io_uring,
+ * so that one thread keeps them all in flight; otherwise, or where io_uring
+ * isn't available, a pool of threads reads them with pread.
+ */
+class file_reader
+{
+public:
+
+	enum class method
+	{
+		pread,
+		uring
+	};
+
+	file_reader();
+
+	~file_reader();
+
+	file_reader(file_reader const&) = delete;
+	file_reader& operator=(file_reader const&) = delete;
+
+	/*
+	 * Returns the method that will actually be used.
+	 */
+	method open(method requested, std::size_t depth);
+
+	inline bool
+	is_open() const
+	{
+		return depth_ > 0;
+	}
+
+	inline std::size_t
+	pending() const
+	{
+		return requests_.size();
+	}
+
+	void submit(std::string path);
+
+	/*
+	 * Tells the kernel that a file will be read soon, so it can start
+	 * reading it into the page cache.
+	 */
+	static void prefetch(std::string const& path);
+
+	/*
+	 * Reads a whole file into data, returning 0 or an error code.
+	 */
+	static int read(std::string const& path, std::vector<unsigned char>& data);
+
+	/*
+	 * Tells the kernel that a file won't be read again, so its pages can
+	 * be dropped from the page cache.
+	 */
+	static void drop(std::string const& path);
+
+	/*
+	 * Waits for the oldest file submitted, and moves its contents into
+	 * data. On failure, error is set to the error code, and data is empty.
+	 * Returns false if no files are pending.
+	 */
+	bool next(std::vector<unsigned char>& data, int& error);
+
+private:
+
+	struct request
+	{
+		std::string path;
+		std::vector<unsigned char> data;
+		std::size_t filled;
+		int fd;
+		int error;
+		bool done;
+	};
+
+	struct uring;
+
+	void pread_work();
+
+	void uring_start(request& r);
+
+	void uring_read(request& r);
+
+	void uring_complete(request& r, int result);
+
+	void uring_finish(request& r, int error);
+
+	bool uring_wait();
+
+	void release_in_flight();
+
+	void abandon_ring();
+
+	method method_;
+	std::size_t depth_;
+	std::deque<std::unique_ptr<request>> requests_;
+	std::deque<request*> waiting_;
+	std::size_t in_flight_;
+	std::unique_ptr<uring> ring_;
+	std::mutex mutex_;
+	std::condition_variable ready_;
+	std::vector<std::thread> threads_;
+	bool stopping_;
+};
+
+#endif /* FILE_READER_H */
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include "hist_matrix.h"
+
+namespace
+{
+
+/*
+ * A tile is (target_tile_rows + search_tile_rows) x bin_tile_width doubles,
+ * 128 KB with these values.
+ */
+constexpr std::size_t target_tile_rows = 32;
+constexpr std::size_t search_tile_rows = 32;
+constexpr std::size_t bin_tile_width = 256;
+constexpr std::size_t cache_line_bins = 64 / sizeof (std::uint32_t);
+
+inline void
+prefetch(void const* p)
+{
+#if defined(__GNUC__)
+	__builtin_prefetch(p, 0, 1);
+#else
+	(void) p;
+#endif
+}
+
+/*
+ * Normalize bins [first_bin, first_bin + width) of rows [first_row, 
+ * first_row + count) into consecutive rows of tile, prefetching the same
+ * bins of the following row while each row is packed.
+ */
+void
+pack_tile(hist_matrix const& matrix, 
+		  std::size_t first_row,
+		  std::size_t count,
+		  std::size_t first_bin,
+		  std::size_t width,
+		  double* tile)
+{
+	for (auto r = 0ul; r < count; ++r)
+	{
+		std::size_t row_index = first_row + r;
+		if (row_index + 1 < matrix.rows())
+		{
+			std::uint32_t const* next = matrix.row(row_index + 1) + first_bin;
+			for (auto b = 0ul; b < width; b += cache_line_bins)
+			{
+				prefetch(next + b);
+			}
+		}
+		std::uint32_t const* bins = matrix.row(row_index) + first_bin;
+		double pixels = static_cast<double> (matrix.pixel_count(row_index));
+		double* dest = tile + r * bin_tile_width;
+		for (auto b = 0ul; b < width; ++b)
+		{
+			dest[b] = static_cast<double> (bins[b]) / pixels;
+		}
+	}
+}
+
+} // namespace
+
+void
+blocked_chi_sqr_dists(hist_matrix const& targets, 
+					  hist_matrix const& search,
+					  dist_visitor const& visit)
+{
+	const std::size_t bin_count = targets.bin_count();
+	std::vector<double> target_tile(target_tile_rows * bin_tile_width);
+	std::vector<double> search_tile(search_tile_rows * bin_tile_width);
+	std::vector<double> sums(target_tile_rows * search_tile_rows);
+
+	for (auto t0 = 0ul; t0 < targets.rows(); t0 += target_tile_rows)
+	{
+		std::size_t t_count = std::min(target_tile_rows, targets.rows() - t0);
+
+		for (auto s0 = 0ul; s0 < search.rows(); s0 += search_tile_rows)
+		{
+			std::size_t s_count = std::min(search_tile_rows, search.rows() - s0);
+			std::fill(sums.begin(), sums.end(), 0.0);
+
+			for (auto b0 = 0ul; b0 < bin_count; b0 += bin_tile_width)
+			{
+				std::size_t width = std::min(bin_tile_width, bin_count - b0);
+				pack_tile(targets, t0, t_count, b0, width, target_tile.data());
+				pack_tile(search, s0, s_count, b0, width, search_tile.data());
+
+				for (auto t = 0ul; t < t_count; ++t)
+				{
+					double const* a = &target_tile[t * bin_tile_width];
+					for (auto s = 0ul; s < s_count; ++s)
+					{
+						double const* b = &search_tile[s * bin_tile_width];
+
+						/*
+						 * accumulate in bin order, as chi_sqr_dist does, so
+						 * the results are bit-for-bit the same
+						 */
+						double sum = sums[t * search_tile_rows + s];
+						for (auto i = 0ul; i < width; ++i)
+						{
+							double diff = a[i] - b[i];
+							double avg = (a[i] + b[i]) / 2.0;
+							if (avg != 0.0)
+							{
+								sum += (diff * diff) / avg;
+							}
+						}
+						sums[t * search_tile_rows + s] = sum;
+					}
+				}
+			}
+
+			for (auto t = 0ul; t < t_count; ++t)
+			{
+				for (auto s = 0ul; s < s_count; ++s)
+				{
+					// ignore null-constructed histograms
+					bool null = targets.pixel_count(t0 + t) == 0 
+							|| search.pixel_count(s0 + s) == 0;
+					visit(t0 + t, s0 + s, 
+						  null ? 0.0 : sums[t * search_tile_rows + s]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef HIST_MATRIX_H
+#define HIST_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * A set of histograms of the same geometry, viewed as the rows of a matrix.
+ * The matrix refers to the histograms' bins; it doesn't copy them.
+ */
+class hist_matrix
+{
+public:
+
+	explicit hist_matrix(std::size_t bin_count)
+	:
+	bin_count_{bin_count}, rows_{}, pixel_counts_{}
+	{
+	}
+
+	inline void
+	append(std::uint32_t const* bins, std::size_t pixel_count)
+	{
+		rows_.push_back(bins);
+		pixel_counts_.push_back(pixel_count);
+	}
+
+	inline std::size_t
+	rows() const
+	{
+		return rows_.size();
+	}
+
+	inline std::size_t
+	bin_count() const
+	{
+		return bin_count_;
+	}
+
+	inline std::uint32_t const*
+	row(std::size_t index) const
+	{
+		return rows_[index];
+	}
+
+	inline std::size_t
+	pixel_count(std::size_t index) const
+	{
+		return pixel_counts_[index];
+	}
+
+private:
+
+	std::size_t bin_count_;
+	std::vector<std::uint32_t const*> rows_;
+	std::vector<std::size_t> pixel_counts_;
+};
+
+using dist_visitor = 
+		std::function<void(std::size_t target, std::size_t search, double distance)>;
+
+/*
+ * Calculates the chi-squared distance between every row of targets and
+ * every row of search, calling visit for each pair. The work is done in
+ * tiles of target rows x search rows x bins, normalized and packed into 
+ * buffers small enough to stay in L2 cache, so each search histogram is 
+ * read from memory once per tile of targets instead of once per target. 
+ * Distances are identical to rgb_image_hist::chi_sqr_dist.
+ */
+void blocked_chi_sqr_dists(hist_matrix const& targets, 
+						   hist_matrix const& search,
+						   dist_visitor const& visit);
+
+#endif /* HIST_MATRIX_H */
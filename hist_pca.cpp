@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include "hist_pca.h"
+
+namespace
+{
+
+constexpr std::uint32_t basis_file_magic = 0x41435049; // "IPCA"
+constexpr std::uint32_t basis_file_version = 1;
+constexpr std::size_t power_iterations = 6;
+
+/*
+ * Orthonormalize the rows of a row-major matrix in place, using modified 
+ * Gram-Schmidt. Rows that are (numerically) linear combinations of earlier
+ * rows are dropped. Returns the number of rows kept.
+ */
+std::size_t
+orthonormalize(std::vector<double>& rows, std::size_t count, std::size_t width)
+{
+	std::size_t kept = 0ul;
+	for (auto r = 0ul; r < count; ++r)
+	{
+		double* row = &rows[r * width];
+		double original_norm = 0.0;
+		for (auto j = 0ul; j < width; ++j)
+		{
+			original_norm += row[j] * row[j];
+		}
+		for (auto q = 0ul; q < kept; ++q)
+		{
+			double const* prev = &rows[q * width];
+			double dot = 0.0;
+			for (auto j = 0ul; j < width; ++j)
+			{
+				dot += row[j] * prev[j];
+			}
+			for (auto j = 0ul; j < width; ++j)
+			{
+				row[j] -= dot * prev[j];
+			}
+		}
+		double norm = 0.0;
+		for (auto j = 0ul; j < width; ++j)
+		{
+			norm += row[j] * row[j];
+		}
+		if (norm <= original_norm * 1.0e-12 || norm == 0.0)
+		{
+			continue;
+		}
+		norm = std::sqrt(norm);
+		double* dest = &rows[kept * width];
+		for (auto j = 0ul; j < width; ++j)
+		{
+			dest[j] = row[j] / norm;
+		}
+		++kept;
+	}
+	return kept;
+}
+
+} // namespace
+
+hist_pca::hist_pca()
+:
+dims_{0}, bin_count_{0}, mean_{}, components_{}
+{
+}
+
+void
+hist_pca::embed(std::uint32_t const* bins, 
+				std::size_t pixel_count, 
+				std::size_t bin_count,
+				float* features) const
+{
+	double pixels = static_cast<double> (pixel_count);
+	for (auto j = 0ul; j < bin_count; ++j)
+	{
+		features[j] = static_cast<float> (std::sqrt(bins[j] / pixels));
+	}
+}
+
+bool
+hist_pca::train(hist_store const& store,
+				std::vector<image_id> const& sample,
+				std::size_t dims)
+{
+	const std::size_t n = sample.size();
+	const std::size_t d = store.bin_count();
+
+	// centered data has rank at most n - 1
+	if (n < 2 || dims == 0)
+	{
+		return false;
+	}
+	dims = std::min(dims, std::min(n - 1, d));
+
+	std::vector<float> features(n * d);
+	std::vector<double> mean(d, 0.0);
+	for (auto i = 0ul; i < n; ++i)
+	{
+		float* row = &features[i * d];
+		embed(store.bins(sample[i]), store.pixel_count(sample[i]), d, row);
+		for (auto j = 0ul; j < d; ++j)
+		{
+			mean[j] += row[j];
+		}
+	}
+	mean_.resize(d);
+	for (auto j = 0ul; j < d; ++j)
+	{
+		mean_[j] = static_cast<float> (mean[j] / n);
+	}
+	for (auto i = 0ul; i < n; ++i)
+	{
+		float* row = &features[i * d];
+		for (auto j = 0ul; j < d; ++j)
+		{
+			row[j] -= mean_[j];
+		}
+	}
+
+	/*
+	 * Block power iteration on the (implicit) covariance matrix, starting
+	 * from a fixed pseudo-random basis so that training is repeatable.
+	 */
+	std::mt19937 gen;
+	std::normal_distribution<double> normal;
+	std::vector<double> basis(dims * d);
+	for (auto& v : basis)
+	{
+		v = normal(gen);
+	}
+	std::size_t rank = orthonormalize(basis, dims, d);
+
+	std::vector<double> scores(n * dims);
+	for (auto iter = 0ul; iter < power_iterations && rank > 0; ++iter)
+	{
+		for (auto i = 0ul; i < n; ++i)
+		{
+			float const* row = &features[i * d];
+			for (auto k = 0ul; k < rank; ++k)
+			{
+				double const* b = &basis[k * d];
+				double dot = 0.0;
+				for (auto j = 0ul; j < d; ++j)
+				{
+					dot += row[j] * b[j];
+				}
+				scores[i * rank + k] = dot;
+			}
+		}
+		std::fill(basis.begin(), basis.end(), 0.0);
+		for (auto i = 0ul; i < n; ++i)
+		{
+			float const* row = &features[i * d];
+			for (auto k = 0ul; k < rank; ++k)
+			{
+				double s = scores[i * rank + k];
+				double* b = &basis[k * d];
+				for (auto j = 0ul; j < d; ++j)
+				{
+					b[j] += s * row[j];
+				}
+			}
+		}
+		rank = orthonormalize(basis, rank, d);
+	}
+
+	if (rank == 0)
+	{
+		return false;
+	}
+
+	components_.resize(rank * d);
+	for (auto i = 0ul; i < rank * d; ++i)
+	{
+		components_[i] = static_cast<float> (basis[i]);
+	}
+	dims_ = rank;
+	bin_count_ = d;
+	return true;
+}
+
+void
+hist_pca::project(std::uint32_t const* bins,
+				  std::size_t pixel_count,
+				  float* projection) const
+{
+	std::vector<float> features(bin_count_);
+	embed(bins, pixel_count, bin_count_, features.data());
+	for (auto j = 0ul; j < bin_count_; ++j)
+	{
+		features[j] -= mean_[j];
+	}
+	for (auto k = 0ul; k < dims_; ++k)
+	{
+		float const* c = &components_[k * bin_count_];
+		double dot = 0.0;
+		for (auto j = 0ul; j < bin_count_; ++j)
+		{
+			dot += c[j] * features[j];
+		}
+		projection[k] = static_cast<float> (dot);
+	}
+}
+
+double
+hist_pca::screen_dist(float const* a, float const* b, std::size_t dims)
+{
+	double sum = 0.0;
+	for (auto k = 0ul; k < dims; ++k)
+	{
+		double diff = a[k] - b[k];
+		sum += diff * diff;
+	}
+	// shave a little off to allow for rounding in the single-precision basis
+	return 2.0 * sum * (1.0 - 1.0e-4);
+}
+
+bool
+hist_pca::save(std::string const& filename) const
+{
+	std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+	std::uint64_t dims = dims_;
+	std::uint64_t bin_count = bin_count_;
+	out.write(reinterpret_cast<char const*> (&basis_file_magic), sizeof (basis_file_magic));
+	out.write(reinterpret_cast<char const*> (&basis_file_version), sizeof (basis_file_version));
+	out.write(reinterpret_cast<char const*> (&bin_count), sizeof (bin_count));
+	out.write(reinterpret_cast<char const*> (&dims), sizeof (dims));
+	out.write(reinterpret_cast<char const*> (mean_.data()), 
+			  mean_.size() * sizeof (float));
+	out.write(reinterpret_cast<char const*> (components_.data()), 
+			  components_.size() * sizeof (float));
+	return static_cast<bool> (out);
+}
+
+bool
+hist_pca::load(std::string const& filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+	std::uint32_t magic = 0;
+	std::uint32_t version = 0;
+	std::uint64_t bin_count = 0;
+	std::uint64_t dims = 0;
+	in.read(reinterpret_cast<char*> (&magic), sizeof (magic));
+	in.read(reinterpret_cast<char*> (&version), sizeof (version));
+	in.read(reinterpret_cast<char*> (&bin_count), sizeof (bin_count));
+	in.read(reinterpret_cast<char*> (&dims), sizeof (dims));
+	if (!in || magic != basis_file_magic || version != basis_file_version
+		|| bin_count == 0 || dims == 0 || dims > bin_count)
+	{
+		return false;
+	}
+	std::vector<float> mean(bin_count);
+	std::vector<float> components(dims * bin_count);
+	in.read(reinterpret_cast<char*> (mean.data()), mean.size() * sizeof (float));
+	in.read(reinterpret_cast<char*> (components.data()), 
+			components.size() * sizeof (float));
+	if (!in)
+	{
+		return false;
+	}
+	mean_ = std::move(mean);
+	components_ = std::move(components);
+	dims_ = dims;
+	bin_count_ = bin_count;
+	return true;
+}
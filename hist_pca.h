@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef HIST_PCA_H
+#define HIST_PCA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "hist_store.h"
+
+/*
+ * A PCA basis for histograms, learned from a sample of the corpus.
+ * 
+ * Histograms are embedded as the square roots of their normalized bins. For
+ * that embedding, 2 * |x - y|^2 never exceeds the chi-squared distance
+ * between the original histograms, and projecting onto an orthonormal basis
+ * can only shrink |x - y|. The distance between two projections is therefore
+ * a lower bound on the full distance, and can be used to reject pairs
+ * before the full distance is calculated.
+ */
+
+class hist_pca
+{
+public:
+
+	static constexpr std::size_t
+	default_dims()
+	{
+		return 64;
+	}
+
+	static constexpr std::size_t
+	default_sample_size()
+	{
+		return 1024;
+	}
+
+	hist_pca();
+
+	inline bool
+	is_valid() const
+	{
+		return dims_ != 0ul;
+	}
+
+	inline std::size_t
+	dims() const
+	{
+		return dims_;
+	}
+
+	inline std::size_t
+	bin_count() const
+	{
+		return bin_count_;
+	}
+
+	bool train(hist_store const& store,
+			   std::vector<image_id> const& sample,
+			   std::size_t dims);
+
+	void project(std::uint32_t const* bins,
+				 std::size_t pixel_count,
+				 float* projection) const;
+
+	/*
+	 * Returns a lower bound on the chi-squared distance between the 
+	 * histograms whose projections are a and b.
+	 */
+	static double screen_dist(float const* a, float const* b, std::size_t dims);
+
+	bool save(std::string const& filename) const;
+
+	bool load(std::string const& filename);
+
+private:
+
+	void embed(std::uint32_t const* bins, 
+			   std::size_t pixel_count, 
+			   std::size_t bin_count,
+			   float* features) const;
+
+	std::size_t dims_;
+	std::size_t bin_count_;
+	std::vector<float> mean_;
+	std::vector<float> components_; // dims_ rows of bin_count_ values
+};
+
+#endif /* HIST_PCA_H */
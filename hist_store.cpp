@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include "hist_store.h"
+
+hist_store::hist_store(hist_geometry geometry)
+:
+geometry_{geometry},
+screen_geometry_{geometry},
+bin_count_{hist_geometry_bin_count(geometry)},
+screen_bin_count_{0},
+projection_dims_{0},
+bins_{},
+screen_bins_{},
+projections_{},
+pixel_counts_{},
+fingerprints_{}
+{
+}
+
+void
+hist_store::set_geometry(hist_geometry geometry)
+{
+	geometry_ = geometry;
+	bin_count_ = hist_geometry_bin_count(geometry);
+	resize(0);
+}
+
+void
+hist_store::set_screen_geometry(hist_geometry geometry)
+{
+	screen_geometry_ = geometry;
+	screen_bin_count_ = hist_geometry_bin_count(geometry);
+	resize(0);
+}
+
+void
+hist_store::set_projection_dims(std::size_t dims)
+{
+	projection_dims_ = dims;
+	projections_.assign(size() * dims, 0.0f);
+}
+
+void
+hist_store::set_memory_budget(std::size_t budget, std::string const& spill_dir)
+{
+	/*
+	 * the budget is shared between the two matrices in proportion to 
+	 * their row sizes
+	 */
+	std::size_t total = bin_count_ + screen_bin_count_;
+	bins_.set_spill(budget / total * bin_count_, spill_dir);
+	screen_bins_.set_spill(budget / total * screen_bin_count_, spill_dir);
+}
+
+void
+hist_store::resize(std::size_t count)
+{
+	bins_.resize(count * bin_count_);
+	screen_bins_.resize(count * screen_bin_count_);
+	projections_.resize(count * projection_dims_, 0.0f);
+	pixel_counts_.resize(count, 0);
+	fingerprints_.resize(count, 0);
+}
+
+void
+hist_store::set(image_id id, image_hist const& hist)
+{
+	std::copy(hist.data(), hist.data() + bin_count_, 
+			  &bins_[static_cast<std::size_t> (id) * bin_count_]);
+	pixel_counts_[id] = hist.pixel_count();
+	fingerprints_[id] = hist.fingerprint();
+}
+
+void
+hist_store::set(image_id id, 
+				std::uint32_t const* bins, 
+				std::size_t pixel_count, 
+				std::uint64_t fingerprint)
+{
+	std::copy(bins, bins + bin_count_, 
+			  &bins_[static_cast<std::size_t> (id) * bin_count_]);
+	pixel_counts_[id] = pixel_count;
+	fingerprints_[id] = fingerprint;
+}
+
+void
+hist_store::set_screen(image_id id)
+{
+	coarsen_row(geometry_, bins(id), screen_geometry_, 
+				&screen_bins_[static_cast<std::size_t> (id) * screen_bin_count_]);
+}
+
+void
+hist_store::set_screen(image_id id, image_hist const& hist)
+{
+	std::copy(hist.data(), hist.data() + screen_bin_count_, 
+			  &screen_bins_[static_cast<std::size_t> (id) * screen_bin_count_]);
+}
+
+void
+hist_store::release(image_id first, image_id last)
+{
+	bins_.release(static_cast<std::size_t> (first) * bin_count_,
+				  static_cast<std::size_t> (last) * bin_count_);
+	screen_bins_.release(static_cast<std::size_t> (first) * screen_bin_count_,
+						 static_cast<std::size_t> (last) * screen_bin_count_);
+}
+
+void
+hist_store::copy(image_id to, image_id from)
+{
+	std::copy(bins(from), bins(from) + bin_count_, 
+			  &bins_[static_cast<std::size_t> (to) * bin_count_]);
+	/* the screen bins and projections may not exist */
+	if (screen_bin_count_ > 0)
+	{
+		std::copy(screen_bins(from), screen_bins(from) + screen_bin_count_, 
+				  &screen_bins_[static_cast<std::size_t> (to) * screen_bin_count_]);
+	}
+	if (projection_dims_ > 0)
+	{
+		std::copy(projection(from), projection(from) + projection_dims_, 
+				  projection(to));
+	}
+	pixel_counts_[to] = pixel_counts_[from];
+	fingerprints_[to] = fingerprints_[from];
+}
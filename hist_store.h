@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef HIST_STORE_H
+#define HIST_STORE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "bin_buffer.h"
+#include "image_hist.h"
+
+using image_id = std::uint32_t;
+
+/*
+ * The histograms of every image, stored as the rows of one contiguous
+ * matrix indexed by image id, with per-image pixel counts and fingerprints
+ * in parallel arrays. Optionally, each image also has a row in a matrix of
+ * coarser screening histograms, and a row of PCA projections.
+ *
+ * Ids are assigned by the caller and are dense; an id whose image has no
+ * histogram (because it couldn't be decoded, or because it's a byte-identical
+ * copy of another image) has a pixel count of zero.
+ */
+class hist_store
+{
+public:
+
+	explicit hist_store(hist_geometry geometry = hist_geometry::bins_16);
+
+	/*
+	 * Changing the geometries discards all of the rows.
+	 */
+	void set_geometry(hist_geometry geometry);
+
+	void set_screen_geometry(hist_geometry geometry);
+
+	void set_projection_dims(std::size_t dims);
+
+	/*
+	 * Once the histograms need more than budget bytes, they're moved to a
+	 * temporary file in spill_dir and mapped from there, so that rows not
+	 * in use can be paged out.
+	 */
+	void set_memory_budget(std::size_t budget, std::string const& spill_dir);
+
+	void resize(std::size_t count);
+
+	void set(image_id id, image_hist const& hist);
+
+	void set(image_id id, 
+			 std::uint32_t const* bins, 
+			 std::size_t pixel_count, 
+			 std::uint64_t fingerprint);
+
+	void set_screen(image_id id, image_hist const& hist);
+
+	/*
+	 * Sets the screening histogram by coarsening the full histogram.
+	 */
+	void set_screen(image_id id);
+
+	void copy(image_id to, image_id from);
+
+	/*
+	 * Drops the rows of ids [first, last) from memory, if they've been 
+	 * spilled; they're read back when they're next used.
+	 */
+	void release(image_id first, image_id last);
+
+	inline hist_geometry
+	geometry() const
+	{
+		return geometry_;
+	}
+
+	inline hist_geometry
+	screen_geometry() const
+	{
+		return screen_geometry_;
+	}
+
+	inline bool
+	has_screen() const
+	{
+		return screen_bin_count_ > 0;
+	}
+
+	inline std::size_t
+	size() const
+	{
+		return pixel_counts_.size();
+	}
+
+	inline std::size_t
+	bin_count() const
+	{
+		return bin_count_;
+	}
+
+	inline bool
+	is_spilled() const
+	{
+		return bins_.is_spilled();
+	}
+
+	inline std::size_t
+	row_bytes() const
+	{
+		return (bin_count_ + screen_bin_count_) * sizeof (std::uint32_t);
+	}
+
+	inline std::size_t
+	projection_dims() const
+	{
+		return projection_dims_;
+	}
+
+	inline bool
+	has_hist(image_id id) const
+	{
+		return pixel_counts_[id] != 0;
+	}
+
+	inline std::uint32_t const*
+	bins(image_id id) const
+	{
+		return &bins_[static_cast<std::size_t> (id) * bin_count_];
+	}
+
+	inline std::uint32_t const*
+	screen_bins(image_id id) const
+	{
+		return &screen_bins_[static_cast<std::size_t> (id) * screen_bin_count_];
+	}
+
+	inline std::size_t
+	pixel_count(image_id id) const
+	{
+		return pixel_counts_[id];
+	}
+
+	inline std::uint64_t
+	fingerprint(image_id id) const
+	{
+		return fingerprints_[id];
+	}
+
+	inline float*
+	projection(image_id id)
+	{
+		return &projections_[static_cast<std::size_t> (id) * projection_dims_];
+	}
+
+	inline float const*
+	projection(image_id id) const
+	{
+		return &projections_[static_cast<std::size_t> (id) * projection_dims_];
+	}
+
+	inline double
+	chi_sqr_dist(image_id a, image_id b,
+				 double bound = std::numeric_limits<double>::infinity()) const
+	{
+		return row_chi_sqr_dist(geometry_, bins(a), pixel_count(a),
+								bins(b), pixel_count(b), bound);
+	}
+
+	inline double
+	screen_dist(image_id a, image_id b,
+				double bound = std::numeric_limits<double>::infinity()) const
+	{
+		return row_chi_sqr_dist(screen_geometry_, screen_bins(a), pixel_count(a),
+								screen_bins(b), pixel_count(b), bound);
+	}
+
+	inline void
+	octant_masses(image_id id, std::array<double, octant_count>& masses) const
+	{
+		row_octant_masses(geometry_, bins(id), pixel_count(id), masses);
+	}
+
+private:
+
+	using float_vector = std::vector<float, aligned_allocator<float>>;
+
+	hist_geometry geometry_;
+	hist_geometry screen_geometry_;
+	std::size_t bin_count_;
+	std::size_t screen_bin_count_;
+	std::size_t projection_dims_;
+	bin_buffer bins_;
+	bin_buffer screen_bins_;
+	float_vector projections_;
+	std::vector<std::uint64_t> pixel_counts_;
+	std::vector<std::uint64_t> fingerprints_;
+};
+
+#endif /* HIST_STORE_H */
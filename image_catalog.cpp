@@ -0,0 +1,205 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include "image_catalog.h"
+
+namespace
+{
+
+constexpr std::uint32_t catalog_file_magic = 0x54434d49; // "IMCT"
+constexpr std::uint32_t catalog_file_version = 1;
+
+template <class T>
+inline void
+write_value(std::ostream& out, T const& value)
+{
+	out.write(reinterpret_cast<char const*> (&value), sizeof (value));
+}
+
+template <class T>
+inline bool
+read_value(std::istream& in, T& value)
+{
+	in.read(reinterpret_cast<char*> (&value), sizeof (value));
+	return static_cast<bool> (in);
+}
+
+} // namespace
+
+image_catalog::image_catalog()
+:
+in_{},
+bin_count_{0},
+entries_{},
+added_{},
+row_{},
+fetched_{0}
+{
+}
+
+bool
+image_catalog::load(std::string const& filename, 
+					hist_geometry geometry, 
+					pair_cache& pairs)
+{
+	in_.open(filename, std::ios::binary);
+	if (!in_)
+	{
+		return false;
+	}
+
+	std::uint32_t magic = 0;
+	std::uint32_t version = 0;
+	std::uint32_t bin_count = 0;
+	std::uint64_t image_count = 0;
+	if (!read_value(in_, magic) || !read_value(in_, version) 
+		|| !read_value(in_, bin_count) || !read_value(in_, image_count)
+		|| magic != catalog_file_magic || version != catalog_file_version
+		|| bin_count != hist_geometry_bin_count(geometry))
+	{
+		return false;
+	}
+
+	std::unordered_map<std::string, entry> entries;
+	entries.reserve(image_count);
+	std::string path_string;
+	for (auto i = 0ul; i < image_count; ++i)
+	{
+		std::uint32_t length = 0;
+		entry e{0, 0, 0, 0, 0};
+		if (!read_value(in_, length))
+		{
+			return false;
+		}
+		path_string.resize(length);
+		if (!in_.read(&path_string[0], length)
+			|| !read_value(in_, e.size) || !read_value(in_, e.mtime)
+			|| !read_value(in_, e.pixel_count) || !read_value(in_, e.fingerprint))
+		{
+			return false;
+		}
+		e.offset = static_cast<std::uint64_t> (in_.tellg());
+		if (!in_.seekg(bin_count * sizeof (std::uint32_t), std::ios::cur))
+		{
+			return false;
+		}
+		/* a file that was rewritten while watching is saved again, later */
+		entries[path_string] = e;
+	}
+
+	if (!pairs.read(in_, geometry))
+	{
+		return false;
+	}
+
+	bin_count_ = bin_count;
+	entries_ = std::move(entries);
+	row_.resize(bin_count_);
+	return true;
+}
+
+bool
+image_catalog::contains(fs::path const& p, 
+						std::uint64_t size, 
+						std::time_t mtime) const
+{
+	auto it = entries_.find(p.string());
+	return it != entries_.end() && it->second.size == size 
+			&& it->second.mtime == static_cast<std::int64_t> (mtime);
+}
+
+bool
+image_catalog::fetch(fs::path const& p, 
+					 std::uint64_t size, 
+					 std::time_t mtime, 
+					 hist_store& store, 
+					 image_id id)
+{
+	auto it = entries_.find(p.string());
+	if (it == entries_.end() || it->second.size != size 
+		|| it->second.mtime != static_cast<std::int64_t> (mtime)
+		|| bin_count_ != store.bin_count())
+	{
+		return false;
+	}
+
+	in_.clear();
+	if (!in_.seekg(it->second.offset)
+		|| !in_.read(reinterpret_cast<char*> (row_.data()), 
+					 bin_count_ * sizeof (std::uint32_t)))
+	{
+		return false;
+	}
+	store.set(id, row_.data(), it->second.pixel_count, it->second.fingerprint);
+	++fetched_;
+	return true;
+}
+
+void
+image_catalog::add(image_id id, std::uint64_t size, std::time_t mtime)
+{
+	added_.push_back(stamp{id, size, static_cast<std::int64_t> (mtime)});
+}
+
+bool
+image_catalog::save(std::string const& filename, 
+					hist_store const& store, 
+					path_table const& paths,
+					pair_cache const& pairs) const
+{
+	/*
+	 * the catalog being replaced may still be open for reading, so write
+	 * a new file and move it into place
+	 */
+	std::string temp_filename(filename);
+	temp_filename.append(".tmp");
+	{
+		std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		write_value(out, catalog_file_magic);
+		write_value(out, catalog_file_version);
+		write_value(out, static_cast<std::uint32_t> (store.bin_count()));
+		write_value(out, static_cast<std::uint64_t> (added_.size()));
+		for (auto const& s : added_)
+		{
+			std::string path_string = paths.path(s.id).string();
+			write_value(out, static_cast<std::uint32_t> (path_string.size()));
+			out.write(path_string.data(), path_string.size());
+			write_value(out, s.size);
+			write_value(out, s.mtime);
+			write_value(out, static_cast<std::uint64_t> (store.pixel_count(s.id)));
+			write_value(out, store.fingerprint(s.id));
+			out.write(reinterpret_cast<char const*> (store.bins(s.id)),
+					  store.bin_count() * sizeof (std::uint32_t));
+		}
+		if (!pairs.write(out, store.geometry()))
+		{
+			return false;
+		}
+	}
+	return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
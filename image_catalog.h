@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef IMAGE_CATALOG_H
+#define IMAGE_CATALOG_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+#include "hist_store.h"
+#include "pair_cache.h"
+#include "path_table.h"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Keeps the histograms of a run's images, so a later run can match only
+ * the images that are new or changed since then. Each image is saved with
+ * its path, size and modification time; an image whose file hasn't changed
+ * is read back from the catalog instead of being decoded. The matches found
+ * so far are saved along with the histograms, as a pair cache, so pairs of 
+ * unchanged images aren't compared again, and the match sets they formed
+ * are rebuilt from the saved matches.
+ */
+class image_catalog
+{
+public:
+
+	image_catalog();
+
+	/*
+	 * Loads the catalog's index, and the pair cache saved with it. The
+	 * histograms themselves are read as they're fetched.
+	 */
+	bool load(std::string const& filename, 
+			  hist_geometry geometry, 
+			  pair_cache& pairs);
+
+	/*
+	 * If p is in the catalog with the same size and modification time,
+	 * copies its histogram into the store at id and returns true.
+	 */
+	bool fetch(fs::path const& p, 
+			   std::uint64_t size, 
+			   std::time_t mtime, 
+			   hist_store& store, 
+			   image_id id);
+
+	/*
+	 * Returns true if p is in the catalog with the same size and 
+	 * modification time, so it will be fetched rather than decoded.
+	 */
+	bool contains(fs::path const& p, 
+				  std::uint64_t size, 
+				  std::time_t mtime) const;
+
+	/*
+	 * Adds an image whose histogram is in the store to the next catalog.
+	 */
+	void add(image_id id, std::uint64_t size, std::time_t mtime);
+
+	bool save(std::string const& filename, 
+			  hist_store const& store, 
+			  path_table const& paths,
+			  pair_cache const& pairs) const;
+
+	inline std::size_t
+	size() const
+	{
+		return entries_.size();
+	}
+
+	inline std::size_t
+	fetched() const
+	{
+		return fetched_;
+	}
+
+private:
+
+	struct entry
+	{
+		std::uint64_t size;
+		std::int64_t mtime;
+		std::uint64_t pixel_count;
+		std::uint64_t fingerprint;
+		std::uint64_t offset;
+	};
+
+	struct stamp
+	{
+		image_id id;
+		std::uint64_t size;
+		std::int64_t mtime;
+	};
+
+	std::ifstream in_;
+	std::size_t bin_count_;
+	std::unordered_map<std::string, entry> entries_;
+	std::vector<stamp> added_;
+	std::vector<std::uint32_t> row_;
+	std::size_t fetched_;
+};
+
+#endif /* IMAGE_CATALOG_H */
@@ -20,24 +20,25 @@
  * THE SOFTWARE.
  */
 
+
+#include <cassert>
 #include "image_hist.h"
+#include "content_hash.h"
 #include "bitmap_image.hpp"
 
-rgb_image_hist::rgb_image_hist()
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::basic_rgb_image_hist()
 :
-pixel_count_{0}, bins_({0u})
+bins_({0u}), pixel_count_{0}, fingerprint_{0}
 {
 }
 
-rgb_image_hist::rgb_image_hist(bitmap_image const& image)
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::basic_rgb_image_hist(
+		bitmap_image const& image)
 :
-pixel_count_{image.width() * image.height()}, bins_({0u})
+bins_({0u}), pixel_count_{image.width() * image.height()}, fingerprint_{0}
 {
-//	for (auto& b : bins_)
-//	{
-//		b = 0u;
-//	}
-
 	for (auto ix = 0u; ix < image.width(); ++ix)
 	{
 		for (auto iy = 0u; iy < image.height(); ++iy)
@@ -47,31 +48,322 @@ pixel_count_{image.width() * image.height()}, bins_({0u})
 			++bin(pix);
 		}
 	}
+
+	if (pixel_count_ > 0)
+	{
+		content_hasher hasher;
+		for (auto i = 0ul; i < bin_count; ++i)
+		{
+			double norm = static_cast<double> (bin(i)) / pixel_count();
+			hasher.update(&norm, sizeof (norm));
+		}
+		fingerprint_ = hasher.digest();
+	}
 }
 
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+void
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::octant_masses(
+		std::array<double, octant_count>& masses) const
+{
+	octant_masses(data(), pixel_count(), masses);
+}
+
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+void
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::octant_masses(
+		std::uint32_t const* bins,
+		std::size_t pixel_count,
+		std::array<double, octant_count>& masses)
+{
+	masses.fill(0.0);
+	for (auto i = 0ul; i < bin_count; ++i)
+	{
+		masses[octant(i)] += bins[i];
+	}
+	for (auto& mass : masses)
+	{
+		mass /= pixel_count;
+	}
+}
+
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+double
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::chi_sqr_dist(
+		basic_rgb_image_hist const& other, double bound) const
+{
+	return chi_sqr_dist(data(), pixel_count(), other.data(), other.pixel_count(), 
+						bound);
+}
+
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
 double
-rgb_image_hist::chi_sqr_dist(rgb_image_hist const& other) const
+basic_rgb_image_hist<RedBits, GreenBits, BlueBits>::chi_sqr_dist(
+		std::uint32_t const* bins,
+		std::size_t pixel_count,
+		std::uint32_t const* other_bins,
+		std::size_t other_pixel_count,
+		double bound)
 {
 	// ignore null-contructed histograms
-	if (pixel_count_ == 0 || other.pixel_count_ == 0)
+	if (pixel_count == 0 || other_pixel_count == 0)
 	{
 		return 0.0;
 	}
 
+	// every term is non-negative, so the sum can be checked against bound
+	static constexpr std::size_t bound_check_interval = 64;
+
 	double sum = 0.0;
 
-	for (auto i = 0ul; i < bin_count; ++i)
+	for (auto block = 0ul; block < bin_count; block += bound_check_interval)
 	{
-		double norm = static_cast<double> (bin(i)) / pixel_count();
-		double other_norm = static_cast<double> (other.bin(i)) / other.pixel_count();
-		double diff = norm - other_norm;
-		double avg = (norm + other_norm) / 2.0;
+		for (auto i = block; i < block + bound_check_interval; ++i)
+		{
+			double norm = static_cast<double> (bins[i]) / pixel_count;
+			double other_norm = static_cast<double> (other_bins[i]) / other_pixel_count;
+			double diff = norm - other_norm;
+			double avg = (norm + other_norm) / 2.0;
 
-		if (avg != 0.0)
+			if (avg != 0.0)
+			{
+				sum += (diff * diff) / avg;
+			}
+		}
+		if (sum > bound)
 		{
-			sum += (diff * diff) / avg;
+			break;
 		}
 	}
 
 	return sum;
 }
+
+template class basic_rgb_image_hist<3, 3, 3>;
+template class basic_rgb_image_hist<4, 4, 4>;
+template class basic_rgb_image_hist<5, 5, 5>;
+template class basic_rgb_image_hist<5, 6, 5>;
+
+namespace
+{
+
+struct geometry_info
+{
+	hist_geometry geometry;
+	char const* name;
+	unsigned red_bits;
+	unsigned green_bits;
+	unsigned blue_bits;
+};
+
+const std::array<geometry_info, 4> geometries
+{{
+	{hist_geometry::bins_8, "8", 3, 3, 3},
+	{hist_geometry::bins_16, "16", 4, 4, 4},
+	{hist_geometry::bins_32, "32", 5, 5, 5},
+	{hist_geometry::bins_565, "565", 5, 6, 5}
+}};
+
+geometry_info const&
+info(hist_geometry geometry)
+{
+	return geometries[static_cast<std::size_t> (geometry)];
+}
+
+} // namespace
+
+bool
+parse_hist_geometry(std::string const& name, hist_geometry& geometry)
+{
+	for (auto const& g : geometries)
+	{
+		if (name == g.name)
+		{
+			geometry = g.geometry;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string
+hist_geometry_name(hist_geometry geometry)
+{
+	return info(geometry).name;
+}
+
+std::size_t
+hist_geometry_bin_count(hist_geometry geometry)
+{
+	return std::size_t{1} << (info(geometry).red_bits + info(geometry).green_bits
+			+ info(geometry).blue_bits);
+}
+
+bool
+is_coarser(hist_geometry coarse, hist_geometry fine)
+{
+	return info(coarse).red_bits <= info(fine).red_bits
+			&& info(coarse).green_bits <= info(fine).green_bits
+			&& info(coarse).blue_bits <= info(fine).blue_bits;
+}
+
+void
+coarsen_row(hist_geometry fine, 
+			std::uint32_t const* fine_bins,
+			hist_geometry coarse,
+			std::uint32_t* coarse_bins)
+{
+	geometry_info const& f = info(fine);
+	geometry_info const& c = info(coarse);
+	std::fill(coarse_bins, coarse_bins + hist_geometry_bin_count(coarse), 0u);
+
+	const std::size_t fine_count = hist_geometry_bin_count(fine);
+	const std::size_t green_mask = (std::size_t{1} << f.green_bits) - 1;
+	const std::size_t blue_mask = (std::size_t{1} << f.blue_bits) - 1;
+	for (auto i = 0ul; i < fine_count; ++i)
+	{
+		std::size_t red = i >> (f.green_bits + f.blue_bits);
+		std::size_t green = (i >> f.blue_bits) & green_mask;
+		std::size_t blue = i & blue_mask;
+		std::size_t index = 
+				((red >> (f.red_bits - c.red_bits)) << (c.green_bits + c.blue_bits))
+				| ((green >> (f.green_bits - c.green_bits)) << c.blue_bits)
+				| (blue >> (f.blue_bits - c.blue_bits));
+		coarse_bins[index] += fine_bins[i];
+	}
+}
+
+double
+row_chi_sqr_dist(hist_geometry geometry,
+				 std::uint32_t const* bins,
+				 std::size_t pixel_count,
+				 std::uint32_t const* other_bins,
+				 std::size_t other_pixel_count,
+				 double bound)
+{
+	switch (geometry)
+	{
+	case hist_geometry::bins_8:
+		return rgb_hist_8::chi_sqr_dist(bins, pixel_count, 
+										other_bins, other_pixel_count, bound);
+	case hist_geometry::bins_16:
+		return rgb_image_hist::chi_sqr_dist(bins, pixel_count, 
+											other_bins, other_pixel_count, bound);
+	case hist_geometry::bins_32:
+		return rgb_hist_32::chi_sqr_dist(bins, pixel_count, 
+										 other_bins, other_pixel_count, bound);
+	case hist_geometry::bins_565:
+		return rgb_hist_565::chi_sqr_dist(bins, pixel_count, 
+										  other_bins, other_pixel_count, bound);
+	}
+	return 0.0;
+}
+
+void
+row_octant_masses(hist_geometry geometry,
+				  std::uint32_t const* bins,
+				  std::size_t pixel_count,
+				  std::array<double, octant_count>& masses)
+{
+	switch (geometry)
+	{
+	case hist_geometry::bins_8:
+		rgb_hist_8::octant_masses(bins, pixel_count, masses);
+		break;
+	case hist_geometry::bins_16:
+		rgb_image_hist::octant_masses(bins, pixel_count, masses);
+		break;
+	case hist_geometry::bins_32:
+		rgb_hist_32::octant_masses(bins, pixel_count, masses);
+		break;
+	case hist_geometry::bins_565:
+		rgb_hist_565::octant_masses(bins, pixel_count, masses);
+		break;
+	}
+}
+
+template <class Hist>
+struct image_hist::model : public image_hist::hist_concept
+{
+	model(hist_geometry g, bitmap_image const& image)
+	: geometry_{g}, hist{image}
+	{
+	}
+
+	hist_geometry geometry() const override
+	{
+		return geometry_;
+	}
+
+	std::size_t size() const override
+	{
+		return Hist::size();
+	}
+
+	std::size_t pixel_count() const override
+	{
+		return hist.pixel_count();
+	}
+
+	std::uint64_t fingerprint() const override
+	{
+		return hist.fingerprint();
+	}
+
+	std::uint32_t const* data() const override
+	{
+		return hist.data();
+	}
+
+	void octant_masses(std::array<double, octant_count>& masses) const override
+	{
+		hist.octant_masses(masses);
+	}
+
+	double chi_sqr_dist(hist_concept const& other, double bound) const override
+	{
+		return hist.chi_sqr_dist(static_cast<model const&> (other).hist, bound);
+	}
+
+	hist_geometry geometry_;
+	Hist hist;
+};
+
+image_hist::image_hist()
+:
+self_{}
+{
+}
+
+image_hist::image_hist(hist_geometry geometry, bitmap_image const& image)
+:
+self_{}
+{
+	switch (geometry)
+	{
+	case hist_geometry::bins_8:
+		self_ = std::make_shared<model<rgb_hist_8>>(geometry, image);
+		break;
+	case hist_geometry::bins_16:
+		self_ = std::make_shared<model<rgb_image_hist>>(geometry, image);
+		break;
+	case hist_geometry::bins_32:
+		self_ = std::make_shared<model<rgb_hist_32>>(geometry, image);
+		break;
+	case hist_geometry::bins_565:
+		self_ = std::make_shared<model<rgb_hist_565>>(geometry, image);
+		break;
+	}
+}
+
+double
+image_hist::chi_sqr_dist(image_hist const& other, double bound) const
+{
+	// ignore null-contructed histograms
+	if (!self_ || !other.self_)
+	{
+		return 0.0;
+	}
+	assert(geometry() == other.geometry());
+	return self_->chi_sqr_dist(*other.self_, bound);
+}
@@ -20,11 +20,15 @@
  * THE SOFTWARE.
  */
 
+
 #ifndef IMAGE_HIST_H
 #define IMAGE_HIST_H
 
 #include <cstdint>
 #include <array>
+#include <limits>
+#include <memory>
+#include <string>
 
 class bitmap_image;
 
@@ -43,15 +47,101 @@ struct rgb_value
 	std::uint8_t blue;
 };
 
-class rgb_image_hist
+/*
+ * The supported histogram geometries. Each has a specialized instantiation
+ * of basic_rgb_image_hist.
+ */
+enum class hist_geometry
+{
+	bins_8,		// 8 bins on each axis, 512 bins
+	bins_16,	// 16 bins on each axis, 4096 bins
+	bins_32,	// 32 bins on each axis, 32768 bins
+	bins_565	// 32, 64 and 32 bins on the red, green and blue axes, 65536 bins
+};
+
+bool parse_hist_geometry(std::string const& name, hist_geometry& geometry);
+
+std::string hist_geometry_name(hist_geometry geometry);
+
+std::size_t hist_geometry_bin_count(hist_geometry geometry);
+
+/*
+ * True if every axis of coarse has no more bins than the corresponding 
+ * axis of fine. Each bin of the coarse geometry is then a union of bins
+ * of the fine geometry, so distances between coarse histograms are lower
+ * bounds on distances between fine histograms.
+ */
+bool is_coarser(hist_geometry coarse, hist_geometry fine);
+
+constexpr std::size_t octant_count = 8;
+
+/*
+ * Distances and octant masses of histograms stored as bare rows of bins, 
+ * dispatched to the instantiation for the geometry.
+ */
+double row_chi_sqr_dist(hist_geometry geometry,
+						std::uint32_t const* bins,
+						std::size_t pixel_count,
+						std::uint32_t const* other_bins,
+						std::size_t other_pixel_count,
+						double bound = std::numeric_limits<double>::infinity());
+
+void row_octant_masses(hist_geometry geometry,
+					   std::uint32_t const* bins,
+					   std::size_t pixel_count,
+					   std::array<double, octant_count>& masses);
+
+/*
+ * Sums the bins of a histogram into the bins of a coarser geometry, which
+ * gives the same histogram as building the coarser one from the image.
+ */
+void coarsen_row(hist_geometry fine, 
+				 std::uint32_t const* fine_bins,
+				 hist_geometry coarse,
+				 std::uint32_t* coarse_bins);
+
+/*
+ * A color histogram with 2^RedBits, 2^GreenBits and 2^BlueBits bins on the 
+ * red, green and blue axes. A pixel's bin is found by taking the high-order 
+ * bits of each channel.
+ */
+template <unsigned RedBits, unsigned GreenBits, unsigned BlueBits>
+class basic_rgb_image_hist
 {
 public:
-	
-	rgb_image_hist(bitmap_image const& image);
 
-	rgb_image_hist();
+	static_assert(RedBits >= 1 && RedBits <= 8 
+			&& GreenBits >= 1 && GreenBits <= 8
+			&& BlueBits >= 1 && BlueBits <= 8,
+			"bits per axis must be between 1 and 8");
+
+	static constexpr std::size_t bin_count = 
+			std::size_t{1} << (RedBits + GreenBits + BlueBits);
 
-	double chi_sqr_dist(rgb_image_hist const& other) const;
+	static constexpr std::size_t octant_count = ::octant_count;
+
+	basic_rgb_image_hist(bitmap_image const& image);
+
+	basic_rgb_image_hist();
+
+	static constexpr std::size_t
+	size()
+	{
+		return bin_count;
+	}
+
+	/*
+	 * If the distance exceeds bound, the calculation may stop early, 
+	 * returning a partial sum that is greater than bound.
+	 */
+	double chi_sqr_dist(basic_rgb_image_hist const& other,
+						double bound = std::numeric_limits<double>::infinity()) const;
+
+	static double chi_sqr_dist(std::uint32_t const* bins,
+							   std::size_t pixel_count,
+							   std::uint32_t const* other_bins,
+							   std::size_t other_pixel_count,
+							   double bound = std::numeric_limits<double>::infinity());
 	
 	inline bool
 	is_valid() const
@@ -64,6 +154,28 @@ public:
 	{
 		return pixel_count_;
 	}
+
+	/*
+	 * A hash of the normalized bins. Histograms with a distance of 0
+	 * have the same fingerprint.
+	 */
+	inline std::uint64_t
+	fingerprint() const
+	{
+		return fingerprint_;
+	}
+
+	/*
+	 * Normalized pixel counts in each octant of the color cube (i.e., in a
+	 * histogram with two bins on each axis). Merging bins never increases the
+	 * distance, so the distance between octant masses is a lower bound on the
+	 * distance between the full histograms.
+	 */
+	void octant_masses(std::array<double, octant_count>& masses) const;
+
+	static void octant_masses(std::uint32_t const* bins,
+							  std::size_t pixel_count,
+							  std::array<double, octant_count>& masses);
 	
 	inline std::uint32_t& operator[](rgb_value const& pixel)
 	{
@@ -85,15 +197,40 @@ public:
 		return bin(index);
 	}
 
+	inline std::uint32_t const*
+	data() const
+	{
+		return bins_.data();
+	}
+
+	static constexpr std::size_t
+	bin_index(std::uint8_t red, std::uint8_t green, std::uint8_t blue)
+	{
+		return (static_cast<std::size_t> (red >> (8 - RedBits)) 
+						<< (GreenBits + BlueBits))
+				| (static_cast<std::size_t> (green >> (8 - GreenBits)) 
+						<< BlueBits)
+				| static_cast<std::size_t> (blue >> (8 - BlueBits));
+	}
+
+	static constexpr std::size_t
+	bin_index(rgb_value const& pixel)
+	{
+		return bin_index(pixel.red, pixel.green, pixel.blue);
+	}
+
+	/*
+	 * The octant of a bin is given by the high-order bit of each axis.
+	 */
+	static constexpr std::size_t
+	octant(std::size_t index)
+	{
+		return (((index >> (RedBits + GreenBits + BlueBits - 1)) & 1) << 2)
+				| (((index >> (GreenBits + BlueBits - 1)) & 1) << 1)
+				| ((index >> (BlueBits - 1)) & 1);
+	}
+
 protected:
-	static constexpr std::size_t channel_depth = 256;
-	static constexpr std::size_t bins_on_axis = 16;
-	static constexpr std::size_t axis_shift = 4; // log2(bins_on_axis)
-	static constexpr std::size_t bin_count =
-			bins_on_axis * bins_on_axis * bins_on_axis;
-	static constexpr std::size_t bin_width = channel_depth / bins_on_axis;
-	static constexpr std::size_t bin_index_mask = bin_width - 1;
-	static constexpr std::size_t channel_to_bin_index_shift = 4; // log2(bin_width)
 	
 	inline std::uint32_t&
 	bin(std::size_t index)
@@ -131,26 +268,104 @@ protected:
 		return bin(bin_index(red, green, blue));
 	}
 
+	std::array<std::uint32_t, bin_count> bins_;
+	std::size_t pixel_count_;
+	std::uint64_t fingerprint_;
+};
+
+/*
+ * The specialized instantiations; these are explicitly instantiated in
+ * image_hist.cpp.
+ */
+using rgb_hist_8 = basic_rgb_image_hist<3, 3, 3>;
+using rgb_image_hist = basic_rgb_image_hist<4, 4, 4>;
+using rgb_hist_32 = basic_rgb_image_hist<5, 5, 5>;
+using rgb_hist_565 = basic_rgb_image_hist<5, 6, 5>;
+
+/*
+ * A histogram of any supported geometry, chosen at run time. Copies share
+ * the (immutable) underlying histogram. Distances may only be calculated 
+ * between histograms of the same geometry.
+ */
+class image_hist
+{
+public:
+
+	static constexpr std::size_t octant_count = ::octant_count;
+
+	image_hist();
+
+	image_hist(hist_geometry geometry, bitmap_image const& image);
+
+	inline bool
+	is_valid() const
+	{
+		return self_ && self_->pixel_count() != 0ul;
+	}
+
+	inline hist_geometry
+	geometry() const
+	{
+		return self_->geometry();
+	}
+
 	inline std::size_t
-	bin_index(std::uint8_t red, std::uint8_t green, std::uint8_t blue) const
+	size() const
 	{
-		std::size_t result = (red >> channel_to_bin_index_shift);
-		result <<= axis_shift;
-		result |= (green >> channel_to_bin_index_shift);
-		result <<= axis_shift;
-		result |= (blue >> channel_to_bin_index_shift);
-		return result;
+		return self_ ? self_->size() : 0ul;
 	}
-	
+
 	inline std::size_t
-	bin_index(rgb_value const& pixel) const
+	pixel_count() const
 	{
-		return bin_index(pixel.red, pixel.green, pixel.blue);
+		return self_ ? self_->pixel_count() : 0ul;
 	}
 
-	std::array<std::uint32_t, bin_count> bins_;
-	std::size_t pixel_count_;
+	inline std::uint64_t
+	fingerprint() const
+	{
+		return self_ ? self_->fingerprint() : 0ul;
+	}
+
+	inline std::uint32_t const*
+	data() const
+	{
+		return self_->data();
+	}
+
+	inline std::uint32_t
+	operator[](std::size_t index) const
+	{
+		return data()[index];
+	}
+
+	inline void
+	octant_masses(std::array<double, octant_count>& masses) const
+	{
+		self_->octant_masses(masses);
+	}
+
+	double chi_sqr_dist(image_hist const& other,
+						double bound = std::numeric_limits<double>::infinity()) const;
+
+private:
+
+	struct hist_concept
+	{
+		virtual ~hist_concept() = default;
+		virtual hist_geometry geometry() const = 0;
+		virtual std::size_t size() const = 0;
+		virtual std::size_t pixel_count() const = 0;
+		virtual std::uint64_t fingerprint() const = 0;
+		virtual std::uint32_t const* data() const = 0;
+		virtual void octant_masses(std::array<double, octant_count>& masses) const = 0;
+		virtual double chi_sqr_dist(hist_concept const& other, double bound) const = 0;
+	};
+
+	template <class Hist>
+	struct model;
+
+	std::shared_ptr<hist_concept const> self_;
 };
 
 #endif /* IMAGE_HIST_H */
-
@@ -0,0 +1,493 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include "image_index.h"
+#include "hist_store.h"
+#include "image_hist.h"
+#include "read_bmp.h"
+#include "read_jpeg.h"
+#include "read_png.h"
+#include "bitmap_image.hpp"
+
+namespace
+{
+
+constexpr std::uint32_t index_file_magic = 0x58494d49; // "IMIX"
+constexpr std::uint32_t index_file_version = 1;
+
+template <class T>
+inline void
+write_value(std::ostream& out, T const& value)
+{
+	out.write(reinterpret_cast<char const*> (&value), sizeof (value));
+}
+
+template <class T>
+inline bool
+read_value(std::istream& in, T& value)
+{
+	in.read(reinterpret_cast<char*> (&value), sizeof (value));
+	return static_cast<bool> (in);
+}
+
+inline void
+write_string(std::ostream& out, std::string const& s)
+{
+	write_value(out, static_cast<std::uint32_t> (s.size()));
+	out.write(s.data(), s.size());
+}
+
+inline bool
+read_string(std::istream& in, std::string& s)
+{
+	std::uint32_t length = 0;
+	if (!read_value(in, length))
+	{
+		return false;
+	}
+	s.resize(length);
+	return length == 0 || static_cast<bool> (in.read(&s[0], length));
+}
+
+/*
+ * recognizes the format from the first bytes of the image
+ */
+bool
+decode_buffer(unsigned char const* data, std::size_t size, bitmap_image& image)
+{
+	/* a library mustn't write to its host's output; failure is returned */
+	std::string error;
+	if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+	{
+		return read_jpeg_buffer(data, size, image, &error);
+	}
+	if (size >= 4 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' 
+		&& data[3] == 'G')
+	{
+		return read_png_buffer(data, size, image, &error);
+	}
+	if (size >= 2 && data[0] == 'B' && data[1] == 'M')
+	{
+		return read_bmp_buffer(data, size, image);
+	}
+	return false;
+}
+
+bool
+read_file(std::string const& path, std::vector<unsigned char>& contents)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+	contents.assign(std::istreambuf_iterator<char> (in), 
+					std::istreambuf_iterator<char> ());
+	return !in.bad();
+}
+
+struct nearer
+{
+	inline bool
+	operator()(image_index::neighbor const& a, image_index::neighbor const& b) const
+	{
+		return a.distance < b.distance || (a.distance == b.distance && a.id < b.id);
+	}
+};
+
+} // namespace
+
+struct image_index::impl
+{
+	hist_store store;
+	std::vector<std::string> names;
+
+	impl()
+	:
+	store{hist_geometry::bins_16}, names{}
+	{
+	}
+
+	std::uint32_t
+	append(std::string const& name)
+	{
+		auto id = static_cast<std::uint32_t> (names.size());
+		names.push_back(name);
+		store.resize(names.size());
+		return id;
+	}
+
+	bool
+	is_compatible(histogram const& hist) const
+	{
+		return hist.bins.size() == store.bin_count() && hist.pixel_count != 0;
+	}
+
+	inline double
+	distance(histogram const& hist, std::uint32_t id, double bound) const
+	{
+		return row_chi_sqr_dist(store.geometry(), hist.bins.data(), hist.pixel_count,
+								store.bins(id), store.pixel_count(id), bound);
+	}
+};
+
+image_index::image_index()
+:
+impl_{new impl}
+{
+}
+
+image_index::~image_index()
+{
+}
+
+bool
+image_index::set_bins(std::string const& bins)
+{
+	hist_geometry geometry;
+	if (!parse_hist_geometry(bins, geometry))
+	{
+		return false;
+	}
+	impl_->store.set_geometry(geometry);
+	impl_->names.clear();
+	return true;
+}
+
+std::string
+image_index::bins() const
+{
+	return hist_geometry_name(impl_->store.geometry());
+}
+
+bool
+image_index::histogram_from_file(std::string const& path, histogram& hist) const
+{
+	std::vector<unsigned char> contents;
+	return read_file(path, contents) 
+			&& histogram_from_buffer(contents.data(), contents.size(), hist);
+}
+
+bool
+image_index::histogram_from_buffer(void const* data, 
+								   std::size_t size, 
+								   histogram& hist) const
+{
+	bitmap_image image;
+	if (!decode_buffer(static_cast<unsigned char const*> (data), size, image))
+	{
+		return false;
+	}
+	image_hist computed(impl_->store.geometry(), image);
+	if (!computed.is_valid())
+	{
+		return false;
+	}
+	hist.bins.assign(computed.data(), computed.data() + computed.size());
+	hist.pixel_count = computed.pixel_count();
+	hist.fingerprint = computed.fingerprint();
+	return true;
+}
+
+bool
+image_index::add_file(std::string const& path, std::uint32_t& id)
+{
+	histogram hist;
+	return histogram_from_file(path, hist) && add_histogram(path, hist, id);
+}
+
+bool
+image_index::add_buffer(std::string const& name, 
+						void const* data, 
+						std::size_t size, 
+						std::uint32_t& id)
+{
+	histogram hist;
+	return histogram_from_buffer(data, size, hist) && add_histogram(name, hist, id);
+}
+
+bool
+image_index::add_histogram(std::string const& name, 
+						   histogram const& hist, 
+						   std::uint32_t& id)
+{
+	if (!impl_->is_compatible(hist))
+	{
+		return false;
+	}
+	id = impl_->append(name);
+	impl_->store.set(id, hist.bins.data(), hist.pixel_count, hist.fingerprint);
+	return true;
+}
+
+std::size_t
+image_index::size() const
+{
+	return impl_->names.size();
+}
+
+std::string const&
+image_index::name(std::uint32_t id) const
+{
+	static std::string const none;
+	return id < impl_->names.size() ? impl_->names[id] : none;
+}
+
+bool
+image_index::get_histogram(std::uint32_t id, histogram& hist) const
+{
+	if (id >= size())
+	{
+		return false;
+	}
+	hist.bins.assign(impl_->store.bins(id), 
+					 impl_->store.bins(id) + impl_->store.bin_count());
+	hist.pixel_count = impl_->store.pixel_count(id);
+	hist.fingerprint = impl_->store.fingerprint(id);
+	return true;
+}
+
+double
+image_index::distance(histogram const& a, histogram const& b) const
+{
+	if (!impl_->is_compatible(a) || !impl_->is_compatible(b))
+	{
+		return -1.0;
+	}
+	return row_chi_sqr_dist(impl_->store.geometry(), a.bins.data(), a.pixel_count,
+							b.bins.data(), b.pixel_count, 
+							std::numeric_limits<double>::infinity());
+}
+
+double
+image_index::distance(std::uint32_t a, std::uint32_t b) const
+{
+	if (a >= size() || b >= size())
+	{
+		return -1.0;
+	}
+	return impl_->store.chi_sqr_dist(a, b);
+}
+
+std::vector<image_index::neighbor>
+image_index::query(histogram const& hist, double threshold) const
+{
+	std::vector<neighbor> result;
+	if (!impl_->is_compatible(hist))
+	{
+		return result;
+	}
+	for (std::uint32_t id = 0; id < size(); ++id)
+	{
+		double d = impl_->distance(hist, id, threshold);
+		if (d <= threshold)
+		{
+			result.push_back(neighbor{id, d});
+		}
+	}
+	std::sort(result.begin(), result.end(), nearer());
+	return result;
+}
+
+std::vector<image_index::neighbor>
+image_index::nearest(histogram const& hist, std::size_t k) const
+{
+	std::vector<neighbor> result;
+	if (!impl_->is_compatible(hist) || k == 0)
+	{
+		return result;
+	}
+
+	/*
+	 * once the heap is full, only images nearer than its worst matter
+	 */
+	std::priority_queue<neighbor, std::vector<neighbor>, nearer> heap;
+	for (std::uint32_t id = 0; id < size(); ++id)
+	{
+		bool full = heap.size() == k;
+		double bound = full ? heap.top().distance 
+				: std::numeric_limits<double>::infinity();
+		neighbor n{id, impl_->distance(hist, id, bound)};
+		if (!full)
+		{
+			heap.push(n);
+		}
+		else if (nearer()(n, heap.top()))
+		{
+			heap.pop();
+			heap.push(n);
+		}
+	}
+	while (!heap.empty())
+	{
+		result.push_back(heap.top());
+		heap.pop();
+	}
+	std::reverse(result.begin(), result.end());
+	return result;
+}
+
+std::vector<image_index::match>
+image_index::matches(double threshold) const
+{
+	std::vector<match> result;
+	for (std::uint32_t a = 0; a < size(); ++a)
+	{
+		for (std::uint32_t b = a + 1; b < size(); ++b)
+		{
+			double d = impl_->store.chi_sqr_dist(a, b, threshold);
+			if (d <= threshold)
+			{
+				result.push_back(match{a, b, d});
+			}
+		}
+	}
+	return result;
+}
+
+std::vector<std::vector<std::uint32_t>>
+image_index::match_sets(double threshold) const
+{
+	std::vector<std::uint32_t> parent(size());
+	std::iota(parent.begin(), parent.end(), 0u);
+	auto find = [&parent](std::uint32_t x)
+	{
+		while (parent[x] != x)
+		{
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	};
+
+	std::vector<bool> matched(size(), false);
+	for (auto const& m : matches(threshold))
+	{
+		auto ra = find(m.a);
+		auto rb = find(m.b);
+		parent[std::max(ra, rb)] = std::min(ra, rb);
+		matched[m.a] = true;
+		matched[m.b] = true;
+	}
+
+	/*
+	 * roots are the smallest ids of their sets, so sets come out ordered
+	 */
+	std::vector<std::vector<std::uint32_t>> sets;
+	std::vector<std::size_t> set_of(size(), 0);
+	for (std::uint32_t id = 0; id < size(); ++id)
+	{
+		if (!matched[id])
+		{
+			continue;
+		}
+		auto root = find(id);
+		if (root == id)
+		{
+			set_of[id] = sets.size();
+			sets.emplace_back();
+		}
+		sets[set_of[root]].push_back(id);
+	}
+	return sets;
+}
+
+bool
+image_index::save(std::string const& filename) const
+{
+	std::string temp_filename(filename);
+	temp_filename.append(".tmp");
+	{
+		std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		hist_store const& store = impl_->store;
+		write_value(out, index_file_magic);
+		write_value(out, index_file_version);
+		write_string(out, hist_geometry_name(store.geometry()));
+		write_value(out, static_cast<std::uint64_t> (size()));
+		for (std::uint32_t id = 0; id < size(); ++id)
+		{
+			write_string(out, impl_->names[id]);
+			write_value(out, static_cast<std::uint64_t> (store.pixel_count(id)));
+			write_value(out, store.fingerprint(id));
+			out.write(reinterpret_cast<char const*> (store.bins(id)),
+					  store.bin_count() * sizeof (std::uint32_t));
+		}
+		if (!out)
+		{
+			return false;
+		}
+	}
+	return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool
+image_index::load(std::string const& filename)
+{
+	std::ifstream in(filename, std::ios::binary);
+	std::uint32_t magic = 0;
+	std::uint32_t version = 0;
+	std::string geometry_name;
+	hist_geometry geometry;
+	std::uint64_t count = 0;
+	if (!in || !read_value(in, magic) || !read_value(in, version)
+		|| magic != index_file_magic || version != index_file_version
+		|| !read_string(in, geometry_name) 
+		|| !parse_hist_geometry(geometry_name, geometry)
+		|| !read_value(in, count))
+	{
+		return false;
+	}
+
+	std::unique_ptr<impl> loaded(new impl);
+	loaded->store.set_geometry(geometry);
+	histogram hist;
+	hist.bins.resize(loaded->store.bin_count());
+	for (auto i = 0ul; i < count; ++i)
+	{
+		std::string name;
+		std::uint32_t id;
+		if (!read_string(in, name) || !read_value(in, hist.pixel_count)
+			|| !read_value(in, hist.fingerprint)
+			|| !in.read(reinterpret_cast<char*> (hist.bins.data()),
+						hist.bins.size() * sizeof (std::uint32_t))
+			|| !loaded->is_compatible(hist))
+		{
+			return false;
+		}
+		id = loaded->append(name);
+		loaded->store.set(id, hist.bins.data(), hist.pixel_count, hist.fingerprint);
+	}
+	impl_ = std::move(loaded);
+	return true;
+}
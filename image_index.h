@@ -0,0 +1,160 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef IMAGE_INDEX_H
+#define IMAGE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * The C++ interface of libimgmatch: an index of image histograms that can
+ * be built, saved, loaded and queried in-process. Only standard types 
+ * appear here, so the index's internals can change without breaking code
+ * that uses it. (imgmatch.h wraps this for C.)
+ *
+ * Images are identified by dense ids, in the order they were added, and by
+ * a name -- the path of an image read from a file, or whatever name the 
+ * caller gives an image read from memory. Histograms use the same bins
+ * and distance as the imgmatch program.
+ *
+ * Const member functions may be called from several threads at once.
+ */
+class image_index
+{
+public:
+
+	struct histogram
+	{
+		std::vector<std::uint32_t> bins;
+		std::uint64_t pixel_count;
+		std::uint64_t fingerprint;
+	};
+
+	struct neighbor
+	{
+		std::uint32_t id;
+		double distance;
+	};
+
+	struct match
+	{
+		std::uint32_t a;
+		std::uint32_t b;
+		double distance;
+	};
+
+	image_index();
+
+	~image_index();
+
+	image_index(image_index const&) = delete;
+	image_index& operator=(image_index const&) = delete;
+
+	/*
+	 * Sets the histogram bins: "8", "16" (the default), "32" or "565".
+	 * Discards any images already in the index.
+	 */
+	bool set_bins(std::string const& bins);
+
+	std::string bins() const;
+
+	/*
+	 * Computes the histogram of a JPEG, PNG or BMP image, without adding it
+	 * to the index. The format of a buffer is recognized from its contents.
+	 */
+	bool histogram_from_file(std::string const& path, histogram& hist) const;
+
+	bool histogram_from_buffer(void const* data, 
+							   std::size_t size, 
+							   histogram& hist) const;
+
+	/*
+	 * Each of these adds an image, setting id to its id.
+	 */
+	bool add_file(std::string const& path, std::uint32_t& id);
+
+	bool add_buffer(std::string const& name, 
+					void const* data, 
+					std::size_t size, 
+					std::uint32_t& id);
+
+	bool add_histogram(std::string const& name, 
+					   histogram const& hist, 
+					   std::uint32_t& id);
+
+	std::size_t size() const;
+
+	std::string const& name(std::uint32_t id) const;
+
+	bool get_histogram(std::uint32_t id, histogram& hist) const;
+
+	/*
+	 * Returns a negative distance if the histograms don't have the index's
+	 * bins, or an id is out of range.
+	 */
+	double distance(histogram const& a, histogram const& b) const;
+
+	double distance(std::uint32_t a, std::uint32_t b) const;
+
+	/*
+	 * The images within threshold of hist, nearest first.
+	 */
+	std::vector<neighbor> query(histogram const& hist, double threshold) const;
+
+	/*
+	 * The k images nearest hist, nearest first.
+	 */
+	std::vector<neighbor> nearest(histogram const& hist, std::size_t k) const;
+
+	/*
+	 * Every pair of images in the index within threshold of each other, 
+	 * with a < b.
+	 */
+	std::vector<match> matches(double threshold) const;
+
+	/*
+	 * The match sets at threshold: the groups of images connected by 
+	 * matches, each with at least two images, ordered by their smallest id.
+	 */
+	std::vector<std::vector<std::uint32_t>> match_sets(double threshold) const;
+
+	bool save(std::string const& filename) const;
+
+	/*
+	 * Replaces the contents of the index, and its bins, with those saved 
+	 * in filename.
+	 */
+	bool load(std::string const& filename);
+
+private:
+
+	struct impl;
+
+	std::unique_ptr<impl> impl_;
+};
+
+#endif /* IMAGE_INDEX_H */
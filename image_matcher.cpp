@@ -20,11 +20,22 @@
  * THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <unordered_set>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <sys/stat.h>
 #include "read_jpeg.h"
 #include "read_png.h"
 #include "read_bmp.h"
+#include "content_hash.h"
+#include "hist_matrix.h"
 #include "image_matcher.h"
 #include "bitmap_image.hpp"
 
@@ -67,14 +78,16 @@ bool image_matcher::split_filename(std::string const& fname,
 
 bool
 image_matcher::read_image_file(fs::path const& image_path, 
-							   bitmap_image& image) const
+							   bitmap_image& image,
+							   std::vector<unsigned char> const* contents) const
 {
 	std::string suffix = this->filename_suffix(image_path);
 	bool result = true;
 
 	if (is_jpeg_suffix(suffix))
 	{
-		if (!read_jpeg_file(image_path.string(), image))
+		if (!(contents ? read_jpeg_buffer(contents->data(), contents->size(), image)
+					   : read_jpeg_file(image_path.string(), image)))
 		{
 			if (verbose_ == 1) std::cout << std::endl;
 			std::cerr << "error: could not read " << image_path
@@ -84,7 +97,8 @@ image_matcher::read_image_file(fs::path const& image_path,
 	}
 	else if (is_png_suffix(suffix))
 	{
-		if (!read_png_file(image_path.string(), image))
+		if (!(contents ? read_png_buffer(contents->data(), contents->size(), image)
+					   : read_png_file(image_path.string(), image)))
 		{
 			if (verbose_ == 1) std::cout << std::endl;
 			std::cerr << "error: could not read " << image_path
@@ -94,7 +108,8 @@ image_matcher::read_image_file(fs::path const& image_path,
 	}
 	else if (is_bmp_suffix(suffix))
 	{
-		if (!read_bmp_file(image_path.string(), image))
+		if (!(contents ? read_bmp_buffer(contents->data(), contents->size(), image)
+					   : read_bmp_file(image_path.string(), image)))
 		{
 			if (verbose_ == 1) std::cout << std::endl;
 			std::cerr << "error: could not read " << image_path
@@ -257,11 +272,105 @@ image_matcher::set_search_paths(string_vec const& search_dir_strings)
 void
 image_matcher::execute()
 {
-	path_hist_map search_hist_map;
+	image_set search_set;
+
+	if (top_k_ > 0 && !use_target_)
+	{
+		std::cerr << "warning: top-k option requires a target, ignoring top-k"
+				<< std::endl;
+	}
+
+	if (use_target_ && !pair_cache_path_.empty())
+	{
+		std::cerr << "warning: pair cache is only used without a target, "
+				<< "ignoring pair cache" << std::endl;
+	}
+
+	if (use_target_ && !catalog_path_.empty())
+	{
+		std::cerr << "warning: catalog is only used without a target, "
+				<< "ignoring catalog" << std::endl;
+	}
+	else if (!catalog_path_.empty() && !pair_cache_path_.empty())
+	{
+		std::cerr << "warning: catalog keeps its own pair cache, "
+				<< "ignoring pair cache" << std::endl;
+	}
+
+	if (use_target_ && shard_count_ > 0)
+	{
+		std::cerr << "warning: sharding is only done without a target, "
+				<< "ignoring shard" << std::endl;
+	}
+
+	if (use_target_ && watch_)
+	{
+		std::cerr << "warning: watching is only done without a target, "
+				<< "ignoring watch" << std::endl;
+	}
+
+	if (watch_ && search_paths_.empty())
+	{
+		std::cerr << "warning: only search directories can be watched, "
+				<< "ignoring watch" << std::endl;
+		watch_ = false;
+	}
+
+	if (max_memory_ > 0)
+	{
+		char const* spill_dir = std::getenv("TMPDIR");
+		store_.set_memory_budget(max_memory_, spill_dir ? spill_dir : "/var/tmp");
+	}
+
+	if (aspect_tolerance_ >= 0.0 && (!use_target_ || target_is_dir_))
+	{
+		std::cerr << "warning: aspect tolerance requires a target file, "
+				<< "ignoring aspect tolerance" << std::endl;
+	}
+	else if (aspect_tolerance_ >= 0.0)
+	{
+		image_info info;
+		if (probe_image_file(target_path_, info) && info.width > 0 && info.height > 0)
+		{
+			target_aspect_ = static_cast<double> (std::max(info.width, info.height))
+					/ std::min(info.width, info.height);
+		}
+		else
+		{
+			std::cerr << "warning: couldn't read the dimensions of target " 
+					<< target_path_ << ", ignoring aspect tolerance" << std::endl;
+		}
+	}
+
+	if (read_mode_ == read_mode::pread)
+	{
+		reader_.open(file_reader::method::pread, read_depth_);
+	}
+	else if (read_mode_ == read_mode::uring)
+	{
+		reader_.open(file_reader::method::uring, read_depth_);
+	}
+
+	if (uses_catalog())
+	{
+		load_catalog();
+	}
+
+	if (!merge_paths_.empty())
+	{
+		merge_shards();
+		return;
+	}
+
+	if (top_k_ > 0 && use_target_ && !thresholds_.empty())
+	{
+		std::cerr << "warning: thresholds option is ignored with top-k"
+				<< std::endl;
+	}
 	
 	if (use_target_)
 	{
-		path_hist_map target_hist_map;
+		image_set target_set;
 		if (target_is_dir_)
 		{
 			/*
@@ -275,9 +384,9 @@ image_matcher::execute()
 						<< std::endl;
 			}
 			
-			build_histograms(target_path_, target_hist_map);
+			build_histograms(target_path_, target_set);
 			
-			if (target_hist_map.size() < 1)
+			if (target_set.size() < 1)
 			{
 				std::cerr << "warning: target directory " << target_path_
 						<< " contains no image files" << std::endl;
@@ -292,17 +401,11 @@ image_matcher::execute()
 			 * all of the images in search directories
 			 */
 
-			path_ptr target_path_ptr = std::make_shared<fs::path>(target_path_);
-			
-			auto insert_result = unique_paths_.insert(target_path_ptr);
-			if (!insert_result.second)
-			{
-				target_path_ptr = *insert_result.first;
-			}
-			
-			build_histogram(target_path_ptr, target_hist_map);
+			image_id target_id;
+			add_path(target_path_, target_id);
+			build_histogram(target_id, target_set);
 
-			if (target_hist_map.size() < 1)
+			if (target_set.size() < 1)
 			{
 				std::cerr << "error: no target image found at " << target_path_
 						<< std::endl;
@@ -310,36 +413,85 @@ image_matcher::execute()
 			}
 		}
 		
+		scope_ = 1;
 		for (auto it = search_paths_.begin();
 			it != search_paths_.end();
 			++it)
 		{
-			build_histograms(*it, search_hist_map);
+			build_histograms(*it, search_set);
+		}
+		if (has_file_list())
+		{
+			build_listed_histograms(search_set);
 		}
 
-		find_matches(target_hist_map, search_hist_map);
-		
-		for (auto it = target_hist_map.begin(); 
-			 it != target_hist_map.end(); 
-			 ++it)
+		if (use_pca() && !prepare_pca({&target_set, &search_set}))
+		{
+			return;
+		}
+
+		if (top_k_ > 0)
 		{
-			search_hist_map.emplace(*std::make_move_iterator(it));
+			find_nearest(target_set, search_set);
+			report_reading();
+			report_aliases();
+			report_screening();
+			generate_ranked_lists();
+			return;
 		}
 
-		generate_symlinks(search_hist_map);
+		find_matches(target_set, search_set);
+		report_reading();
+		report_aliases();
+		report_screening();
+		generate_results();
 		
 	}
+	else if (shard_count_ > 0)
+	{
+		match_shard();
+	}
 	else if (exhaustive_)
 	{
+		scope_ = 1;
 		for (auto it = search_paths_.begin();
 			it != search_paths_.end();
 			++it)
 		{
-			build_histograms(*it, search_hist_map);
+			build_histograms(*it, search_set);
+		}
+		if (has_file_list())
+		{
+			build_listed_histograms(search_set);
+		}
+
+		if (use_pca() && !prepare_pca({&search_set}))
+		{
+			return;
 		}
 
-		find_matches(search_hist_map);
-		generate_symlinks(search_hist_map);
+		if (load_pair_cache())
+		{
+			find_matches_cached(search_set);
+			save_pair_cache();
+		}
+		else if (store_.is_spilled())
+		{
+			find_matches_spilled(search_set);
+		}
+		else
+		{
+			find_matches(search_set);
+		}
+		if (watch_)
+		{
+			std::vector<image_set> scopes{std::move(search_set)};
+			watch(scopes);
+		}
+		report_reading();
+		report_aliases();
+		report_screening();
+		generate_results();
 	}
 	else
 	{
@@ -348,19 +500,59 @@ image_matcher::execute()
 		 * don't match between directories
 		 */
 
-		for (auto it = search_paths_.begin();
-			it != search_paths_.end();
-			++it)
+		/* the listed files are searched as one more directory */
+		std::vector<image_set> dir_sets(search_paths_.size() 
+										+ (has_file_list() ? 1 : 0));
+		std::vector<image_set const*> dir_set_ptrs;
+
+		for (auto i = 0ul; i < search_paths_.size(); ++i)
+		{
+			scope_ = i + 1;
+			build_histograms(search_paths_[i], dir_sets[i]);
+			dir_set_ptrs.push_back(&dir_sets[i]);
+		}
+		if (has_file_list())
+		{
+			scope_ = dir_sets.size();
+			build_listed_histograms(dir_sets.back());
+			dir_set_ptrs.push_back(&dir_sets.back());
+		}
+
+		if (use_pca() && !prepare_pca(dir_set_ptrs))
+		{
+			return;
+		}
+
+		if (load_pair_cache())
+		{
+			for (auto const& images : dir_sets)
+			{
+				find_matches_cached(images);
+			}
+			save_pair_cache();
+		}
+		else
 		{
-			path_hist_map hmap;
-			build_histograms(*it, hmap);
-			find_matches(hmap);
-			for (auto it = hmap.begin(); it != hmap.end(); ++it)
+			for (auto const& images : dir_sets)
 			{
-				search_hist_map.emplace(*std::make_move_iterator(it));
+				if (store_.is_spilled())
+				{
+					find_matches_spilled(images);
+				}
+				else
+				{
+					find_matches(images);
+				}
 			}
 		}
-		generate_symlinks(search_hist_map);
+		if (watch_)
+		{
+			watch(dir_sets);
+		}
+		report_reading();
+		report_aliases();
+		report_screening();
+		generate_results();
 	}
 }
 
@@ -407,39 +599,6 @@ image_matcher::find_available_name(fs::path const& results_parent,
 	}
 }
 
-bool
-image_matcher::create_symlink(fs::path const& link_target,
-							  std::string const& link_name,
-							  fs::path const& link_parent_dir_path) const
-{
-	// link names must be unique        
-	std::size_t dup_count = 0;
-
-	fs::path link_path(link_parent_dir_path);
-	link_path /= link_name;
-	while (fs::exists(link_path))
-	{
-		std::string dup_link_name("dup");
-		dup_link_name.append(std::to_string(dup_count++))
-				.append("_")
-				.append(link_name);
-		link_path = link_parent_dir_path;
-		link_path /= dup_link_name;
-	}
-	boost::system::error_code ec;
-	fs::create_symlink(link_target, link_path, ec);
-	if (!ec)
-	{
-		return true;
-	}
-	else
-	{
-		std::cerr << "error: could not create symbolic link to " << link_target
-				<< ", error code message: " << ec.message() << std::endl;
-		return false;
-	}
-}
-
 bool
 image_matcher::create_dir(fs::path const& dir_path) const
 {
@@ -467,26 +626,26 @@ image_matcher::create_dir(fs::path const& dir_path) const
 }
 
 void
-image_matcher::create_matching_links(std::vector<path_ptr> const& paths,
-									 std::vector<double> const& distances,
-									 std::size_t set_index) const
+image_matcher::add_matching_links(link_writer& links,
+								  std::vector<image_id> const& ids,
+								  std::vector<double> const& distances,
+								  std::size_t set_index,
+								  bool ranked) const
 {
-	fs::path match_dir_path(results_path_);
 	std::string match_dir_name{"m"};
 	match_dir_name.append(std::to_string(set_index));
-	match_dir_path /= match_dir_name;
-	if (!create_dir(match_dir_path))
-	{
-		std::cerr << "error: couldn't create match set directory " 
-				<< match_dir_path << std::endl;
-		return;
-	}
+	auto dir = links.add_dir(match_dir_name);
 	
-	for (auto i = 0u; i < paths.size(); ++i)
+	for (auto i = 0u; i < ids.size(); ++i)
 	{
+		fs::path link_target = path_of(ids[i]);
 		std::string link_base;
 		std::string link_suffix;
-		split_filename(paths[i]->filename().string(), link_base, link_suffix);
+		split_filename(link_target.filename().string(), link_base, link_suffix);
+		if (ranked)
+		{
+			link_base.insert(0, std::to_string(i).append("_"));
+		}
 		if (annotate_links_)
 		{
 			link_base.append("_").append(std::to_string(distances[i]));
@@ -494,14 +653,7 @@ image_matcher::create_matching_links(std::vector<path_ptr> const& paths,
 		std::string link_name(link_base);
 		link_name.append(link_suffix);
 
-		if (!create_symlink(*paths[i], link_name, match_dir_path))
-		{
-			std::cerr << "error: couldn't create symbolic link " 
-					<< link_name << " in match set directory "
-					<< match_dir_path << " to link target " << *paths[i] 
-					<< std::endl;
- 			return;
-		}
+		links.add_link(dir, link_target, link_name);
 	}
 }
 
@@ -527,6 +679,13 @@ image_matcher::show_options() const
 		std::cout << indent << "search path: " << dir_path << std::endl;
 	}
 
+	if (has_file_list())
+	{
+		std::cout << indent << "files from: " 
+				<< (files_from_ == "-" ? "standard input" : files_from_) 
+				<< std::endl;
+	}
+
 	std::cout << indent << "results path: " << results_path_ << std::endl;
 
 	if (limit_ < 0)
@@ -542,6 +701,105 @@ image_matcher::show_options() const
 			<< std::endl;
 	
 	std::cout << "exhaustive is " << std::boolalpha << exhaustive_ << std::endl;
+
+	std::cout << indent << "bucket limit: " << bucket_limit_ << std::endl;
+
+	if (top_k_ > 0)
+	{
+		std::cout << indent << "top-k: " << top_k_ << std::endl;
+	}
+
+	for (auto const& threshold : thresholds_)
+	{
+		std::cout << indent << "sweep threshold: " << threshold.name << std::endl;
+	}
+
+	if (!pair_cache_path_.empty())
+	{
+		std::cout << indent << "pair cache path: " << pair_cache_path_ << std::endl;
+	}
+
+	if (!catalog_path_.empty())
+	{
+		std::cout << indent << "catalog path: " << catalog_path_ << std::endl;
+	}
+
+	std::cout << indent << "recursive: " << std::boolalpha << recursive_ 
+			<< std::endl;
+
+	if (read_mode_ != read_mode::file)
+	{
+		std::cout << indent << "reader: " 
+				<< (read_mode_ == read_mode::prefetch ? "prefetch" 
+					: read_mode_ == read_mode::pread ? "pread" : "uring")
+				<< ", " << read_depth_ << " files ahead" << std::endl;
+	}
+
+	std::cout << indent << "read order: " 
+			<< (read_order_ == file_order::listed ? "listed" 
+				: read_order_ == file_order::inode ? "inode" : "physical")
+			<< std::endl;
+
+	if (min_megapixels_ > 0.0)
+	{
+		std::cout << indent << "minimum megapixels: " << min_megapixels_ 
+				<< std::endl;
+	}
+	if (max_megapixels_ > 0.0)
+	{
+		std::cout << indent << "maximum megapixels: " << max_megapixels_ 
+				<< std::endl;
+	}
+	if (aspect_tolerance_ >= 0.0)
+	{
+		std::cout << indent << "aspect tolerance: " << aspect_tolerance_ 
+				<< std::endl;
+	}
+
+	std::cout << indent << "drop cache: " << std::boolalpha << drop_cache_ 
+			<< std::endl;
+
+	std::cout << indent << "watch: " << std::boolalpha << watch_ << std::endl;
+
+	if (shard_count_ > 0)
+	{
+		std::cout << indent << "shard: " << shard_ + 1 << "/" << shard_count_ 
+				<< std::endl;
+	}
+
+	for (auto const& merge_path : merge_paths_)
+	{
+		std::cout << indent << "merge: " << merge_path << std::endl;
+	}
+
+	std::cout << indent << "histogram bins: " 
+			<< hist_geometry_name(store_.geometry()) << std::endl;
+	if (store_.has_screen())
+	{
+		std::cout << indent << "screening histogram bins: " 
+				<< hist_geometry_name(store_.screen_geometry()) << std::endl;
+	}
+
+	std::cout << "duplicate hashing is " << (hash_duplicates_ ? "on" : "off")
+			<< std::endl;
+
+	if (use_pca())
+	{
+		std::cout << "pca screening is on" << std::endl;
+		std::cout << indent << "pca dimensions: " 
+				<< (pca_dims_ > 0 ? pca_dims_ : hist_pca::default_dims()) 
+				<< std::endl;
+		if (!pca_basis_path_.empty())
+		{
+			std::cout << indent << "pca basis path: " << pca_basis_path_ 
+					<< std::endl;
+		}
+		std::cout << indent << "pca tolerance: " << pca_tolerance_ << std::endl;
+	}
+	else
+	{
+		std::cout << "pca screening is off" << std::endl;
+	}
 }
 
 void
@@ -591,164 +849,2095 @@ image_matcher::set_limit(int limit)
 }
 
 void
-image_matcher::build_histograms(fs::path const& dir, path_hist_map& hmap)
+image_matcher::set_hash_duplicates(bool value)
 {
-	fs::directory_iterator end_iter;
+	hash_duplicates_ = value;
+}
 
-	if (verbose_ > 0)
+void
+image_matcher::set_bucket_limit(double bucket_limit)
+{
+	bucket_limit_ = bucket_limit; // negative disables buckets
+}
+
+bool
+image_matcher::set_geometry(std::string const& geometry_name)
+{
+	hist_geometry geometry;
+	if (!parse_hist_geometry(geometry_name, geometry))
 	{
-		std::cout << "building histograms for image files in "
-				<< dir << ":" << std::endl;
+		std::cerr << "error: invalid histogram bins: " << geometry_name 
+				<< std::endl;
+		return false;
 	}
+	store_.set_geometry(geometry);
+	return true;
+}
 
-	for (fs::directory_iterator dir_itr(dir);
-		dir_itr != end_iter;
-		++dir_itr)
+bool
+image_matcher::set_screen_geometry(std::string const& geometry_name)
+{
+	hist_geometry screen_geometry;
+	if (!parse_hist_geometry(geometry_name, screen_geometry))
 	{
-		try
-		{
-			fs::path canonical_path(fs::canonical(dir_itr->path()));
-			if (fs::is_regular_file(canonical_path)
-				&& (is_image_file(canonical_path)))
-			{
-				if (limit_ < 0 || unique_paths_.size() < limit_)
-				{
-					if (verbose_ > 1)
-					{
-						std::cout << "found image file: "
-								<< canonical_path.filename() << std::endl;
-					}
-					path_ptr pth = std::make_shared<fs::path>(canonical_path);
-					auto insert_result = unique_paths_.insert(pth);
-					if (insert_result.second)
-					{
-						if (verbose_ > 1)
-						{
-							std::cout << "building histogram for "
-									<< pth->filename() << std::endl;
-						}
-						else if (verbose_ == 1)
-						{
-							std::cout << ".";
-							std::cout.flush();
-						}
-						build_histogram(pth, hmap);
-					}
-				}
-				else
-				{
-					std::cout << "image count limit reached" << std::endl;
-					break;
-				}
-			}
-		}
-		catch (const std::exception & ex)
-		{
-			std::cerr << "error: '" << dir_itr->path().filename() << "' "
-					<< ex.what() << std::endl;
-		}
+		std::cerr << "error: invalid screening histogram bins: " 
+				<< geometry_name << std::endl;
+		return false;
 	}
-	if (verbose_ == 1)
+	
+	/*
+	 * the screening distance is only a lower bound on the full distance if
+	 * the screening histogram's bins are unions of the full histogram's bins
+	 */
+	if (!is_coarser(screen_geometry, store_.geometry()) 
+		|| screen_geometry == store_.geometry())
 	{
-		std::cout << std::endl;
+		std::cerr << "error: screening histogram bins (" << geometry_name 
+				<< ") must be coarser than histogram bins ("
+				<< hist_geometry_name(store_.geometry()) << ")" << std::endl;
+		return false;
 	}
+	store_.set_screen_geometry(screen_geometry);
+	return true;
 }
 
-void image_matcher::find_matches(path_hist_map const& target_hmap, 
-								 path_hist_map const& search_hmap)
+void
+image_matcher::set_top_k(int top_k)
 {
-	for (auto it_targets = target_hmap.begin(); 
-		 it_targets != target_hmap.end(); 
-		 ++it_targets)
+	if (top_k < 0)
 	{
-		for (auto it_search = search_hmap.begin(); 
-			 it_search != search_hmap.end(); 
-			 ++it_search)
-		{
-			compare(it_targets, it_search);
-		}
+		std::cerr << "warning: invalid top-k value, ignoring" << std::endl;
+		top_k = 0;
 	}
+	top_k_ = top_k;
 }
 
-void image_matcher::find_matches(path_hist_map const& hmap)
+bool
+image_matcher::set_output_format(std::string const& format_name)
 {
-	for (auto it_outer = hmap.begin(); it_outer != hmap.end(); ++it_outer)
+	result_format format;
+	if (!parse_result_format(format_name, format))
 	{
-		auto it_inner = it_outer;
-		while (++it_inner != hmap.end())
-		{
-			compare(it_outer, it_inner);
-		}
+		std::cerr << "error: invalid output format: " << format_name 
+				<< std::endl;
+		return false;
 	}
+
+	/*
+	 * results get stdout to themselves; progress and summary messages 
+	 * go to stderr instead
+	 */
+	results_.open(format, std::cout.rdbuf());
+	std::cout.rdbuf(std::cerr.rdbuf());
+	return true;
 }
 
-void image_matcher::compare(path_hist_map::const_iterator a, 
-							path_hist_map::const_iterator b)
+bool
+image_matcher::set_thresholds(std::string const& thresholds_string)
 {
-	if (path_at(a) == path_at(b))
-	{
-		return;
-	}
-	auto distance = histogram_at(a).chi_sqr_dist(histogram_at(b));
-	if (verbose_ > 1)
-	{
-		std::cout << "compared " << *path_at(a) << " with "
-				<< *path_at(b) << ": " << distance << std::endl;
-	}
-	if (distance <= match_threshold_)
+	std::vector<sweep_threshold> thresholds;
+	std::string::size_type start = 0;
+
+	while (start <= thresholds_string.size())
 	{
-		if (verbose_ > 0)
+		auto end = thresholds_string.find(',', start);
+		if (end == std::string::npos)
 		{
-			std::cout << "found match -- " << *path_at(a) << " and "
-					<< *path_at(b) << ": " << distance << std::endl;
+			end = thresholds_string.size();
 		}
-		
-		auto match_set_end = match_set_map_.end();
-		
-		auto a_match_set = match_set_map_.find(path_at(a));
-		auto b_match_set = match_set_map_.find(path_at(b));
-		if (is_end(a_match_set) && is_end(b_match_set))
+		std::string name = thresholds_string.substr(start, end - start);
+		double value = -1.0;
+		try
 		{
-			match_set_ptr new_set = std::make_shared<match_set>();
-			new_set->insert(path_at(a));
-			new_set->insert(path_at(b));
-			match_set_map_.emplace(path_at(a), new_set);
-			match_set_map_.emplace(path_at(b), new_set);
-			match_sets_.insert(new_set);
+			std::size_t used = 0;
+			value = std::stod(name, &used);
+			if (used != name.size())
+			{
+				value = -1.0;
+			}
 		}
-		else if (!is_end(a_match_set) && is_end(b_match_set))
+		catch (std::exception const&)
 		{
-			match_set_map_.emplace(path_at(b), match_set_at(a_match_set));
-			match_set_at(a_match_set)->insert(path_at(b));
 		}
-		else if (is_end(a_match_set) && !is_end(b_match_set))
+		if (!(value >= 0.0))
 		{
-			match_set_map_.emplace(path_at(a), match_set_at(b_match_set));
-			match_set_at(b_match_set)->insert(path_at(a));
+			std::cerr << "error: invalid threshold in thresholds option: " 
+					<< name << std::endl;
+			return false;
 		}
-		else // a_it != end && b_it != end
+		thresholds.push_back(sweep_threshold{value, name});
+		start = end + 1;
+	}
+
+	// loosest first, so the first pass sees every match
+	std::sort(thresholds.begin(), thresholds.end(),
+			  [](sweep_threshold const& a, sweep_threshold const& b)
+			  {
+				  return a.value > b.value;
+			  });
+	thresholds.erase(std::unique(thresholds.begin(), thresholds.end(),
+								 [](sweep_threshold const& a, sweep_threshold const& b)
+								 {
+									 return a.value == b.value;
+								 }),
+					 thresholds.end());
+
+	thresholds_ = std::move(thresholds);
+	match_threshold_ = thresholds_.front().value;
+	return true;
+}
+
+void
+image_matcher::set_pair_cache_path(std::string const& cache_path_string)
+{
+	pair_cache_path_ = fs::system_complete(fs::path(cache_path_string));
+}
+
+bool
+image_matcher::set_files_from(std::string const& list_string)
+{
+	if (list_string == "-")
+	{
+		files_from_ = list_string;
+		return true;
+	}
+	fs::path list_path(fs::system_complete(fs::path(list_string)));
+	if (!fs::exists(list_path) || fs::is_directory(list_path))
+	{
+		std::cerr << "error: file list " << list_string << " not found" 
+				<< std::endl;
+		return false;
+	}
+	files_from_ = list_path.string();
+	return true;
+}
+
+void
+image_matcher::set_recursive(bool value)
+{
+	recursive_ = value;
+}
+
+bool
+image_matcher::set_read_method(std::string const& method_name)
+{
+	if (method_name == "file")
+	{
+		read_mode_ = read_mode::file;
+	}
+	else if (method_name == "prefetch")
+	{
+		read_mode_ = read_mode::prefetch;
+	}
+	else if (method_name == "pread")
+	{
+		read_mode_ = read_mode::pread;
+	}
+	else if (method_name == "uring")
+	{
+		read_mode_ = read_mode::uring;
+	}
+	else
+	{
+		std::cerr << "error: invalid reader: " << method_name << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void
+image_matcher::set_read_depth(int depth)
+{
+	if (depth < 1)
+	{
+		std::cerr << "warning: invalid read depth, using " 
+				<< default_read_depth() << std::endl;
+		depth = default_read_depth();
+	}
+	read_depth_ = depth;
+}
+
+void
+image_matcher::set_min_megapixels(double megapixels)
+{
+	min_megapixels_ = std::max(megapixels, 0.0);
+}
+
+void
+image_matcher::set_max_megapixels(double megapixels)
+{
+	max_megapixels_ = std::max(megapixels, 0.0);
+}
+
+void
+image_matcher::set_aspect_tolerance(double tolerance)
+{
+	if (tolerance < 0.0)
+	{
+		std::cerr << "warning: invalid aspect tolerance, ignoring aspect tolerance"
+				<< std::endl;
+		return;
+	}
+	aspect_tolerance_ = tolerance;
+}
+
+bool
+image_matcher::set_read_order(std::string const& order_name)
+{
+	if (!parse_file_order(order_name, read_order_))
+	{
+		std::cerr << "error: invalid read order: " << order_name << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void
+image_matcher::set_drop_cache(bool value)
+{
+	drop_cache_ = value;
+}
+
+void
+image_matcher::set_watch(bool value)
+{
+	watch_ = value;
+}
+
+bool
+image_matcher::set_shard(std::string const& shard_string)
+{
+	unsigned long shard = 0;
+	unsigned long shard_count = 0;
+	char slash = 0;
+	std::istringstream in(shard_string);
+	if (!(in >> shard >> slash >> shard_count) || slash != '/' || !in.eof()
+		|| shard < 1 || shard > shard_count)
+	{
+		std::cerr << "error: invalid shard '" << shard_string 
+				<< "', expected i/N with 1 <= i <= N" << std::endl;
+		return false;
+	}
+	shard_ = shard - 1;
+	shard_count_ = shard_count;
+	return true;
+}
+
+bool
+image_matcher::set_merge_paths(string_vec const& merge_path_strings)
+{
+	for (auto const& path_string : merge_path_strings)
+	{
+		fs::path merge_path(fs::system_complete(fs::path(path_string)));
+		if (!fs::is_regular_file(merge_path))
+		{
+			std::cerr << "error: edge file " << path_string << " not found" 
+					<< std::endl;
+			return false;
+		}
+		merge_paths_.push_back(merge_path);
+	}
+	if (merge_paths_.empty())
+	{
+		std::cerr << "error: no edge files were specified to merge" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool
+image_matcher::set_max_memory(std::string const& max_memory_string)
+{
+	double value = 0.0;
+	std::string suffix;
+	std::istringstream in(max_memory_string);
+	if (!(in >> value) || value <= 0.0)
+	{
+		std::cerr << "error: invalid memory size '" << max_memory_string 
+				<< "'" << std::endl;
+		return false;
+	}
+	in >> suffix;
+	double scale = 1.0;
+	if (suffix == "k" || suffix == "K")
+	{
+		scale = 1024.0;
+	}
+	else if (suffix == "m" || suffix == "M")
+	{
+		scale = 1024.0 * 1024.0;
+	}
+	else if (suffix == "g" || suffix == "G")
+	{
+		scale = 1024.0 * 1024.0 * 1024.0;
+	}
+	else if (!suffix.empty())
+	{
+		std::cerr << "error: invalid memory size '" << max_memory_string 
+				<< "', expected a number of bytes with an optional K, M or G"
+				<< std::endl;
+		return false;
+	}
+	max_memory_ = static_cast<std::size_t> (value * scale);
+	return true;
+}
+
+void
+image_matcher::set_catalog_path(std::string const& catalog_path_string)
+{
+	catalog_path_ = fs::system_complete(fs::path(catalog_path_string));
+}
+
+void
+image_matcher::set_pca_dims(int dims)
+{
+	if (dims < 0)
+	{
+		std::cerr << "warning: invalid pca dimensions, pca screening disabled" 
+				<< std::endl;
+		dims = 0;
+	}
+	pca_dims_ = dims;
+}
+
+void
+image_matcher::set_pca_basis_path(std::string const& basis_path_string)
+{
+	pca_basis_path_ = fs::system_complete(fs::path(basis_path_string));
+}
+
+void
+image_matcher::set_pca_tolerance(double tolerance)
+{
+	if (tolerance <= 0.0)
+	{
+		std::cerr << "warning: invalid pca tolerance, using default: "
+				<< default_pca_tolerance() << std::endl;
+		tolerance = default_pca_tolerance();
+	}
+	pca_tolerance_ = tolerance;
+}
+
+bool
+image_matcher::prepare_pca(std::vector<image_set const*> const& sets)
+{
+	bool have_basis = false;
+
+	if (!pca_basis_path_.empty() && fs::exists(pca_basis_path_))
+	{
+		if (!pca_.load(pca_basis_path_.string()))
+		{
+			std::cerr << "error: could not load pca basis from " 
+					<< pca_basis_path_ << std::endl;
+			return false;
+		}
+		if (pca_.bin_count() != store_.bin_count())
+		{
+			std::cerr << "error: pca basis " << pca_basis_path_ 
+					<< " was trained on histograms with " << pca_.bin_count() 
+					<< " bins" << std::endl;
+			return false;
+		}
+		if (pca_dims_ > 0 && pca_.dims() != static_cast<std::size_t> (pca_dims_))
+		{
+			std::cerr << "warning: pca basis " << pca_basis_path_ << " has " 
+					<< pca_.dims() << " dimensions, ignoring pca dimensions option"
+					<< std::endl;
+		}
+		if (verbose_ > 0)
+		{
+			std::cout << "loaded " << pca_.dims() << "-dimensional pca basis from "
+					<< pca_basis_path_ << std::endl;
+		}
+		have_basis = true;
+	}
+
+	if (!have_basis)
+	{
+		std::size_t total = 0ul;
+		for (auto images : sets)
+		{
+			total += images->size();
+		}
+		
+		/*
+		 * sample evenly across all of the histograms
+		 */
+
+		std::size_t sample_size = std::min(total, hist_pca::default_sample_size());
+		std::size_t stride = sample_size > 0 ? total / sample_size : 1;
+		std::vector<image_id> sample;
+		sample.reserve(sample_size);
+		std::size_t index = 0ul;
+		for (auto images : sets)
+		{
+			for (auto id : *images)
+			{
+				if (index++ % stride == 0 && sample.size() < sample_size
+					&& store_.has_hist(id))
+				{
+					sample.push_back(id);
+				}
+			}
+		}
+
+		std::size_t dims = pca_dims_ > 0 ? pca_dims_ : hist_pca::default_dims();
+		if (!pca_.train(store_, sample, dims))
+		{
+			std::cerr << "warning: too few images to train pca basis, "
+					<< "pca screening disabled" << std::endl;
+			return true;
+		}
+		if (verbose_ > 0)
+		{
+			std::cout << "trained " << pca_.dims() << "-dimensional pca basis on "
+					<< sample.size() << " histograms" << std::endl;
+		}
+		if (!pca_basis_path_.empty() && !pca_.save(pca_basis_path_.string()))
+		{
+			std::cerr << "warning: could not save pca basis to " 
+					<< pca_basis_path_ << std::endl;
+		}
+	}
+
+	store_.set_projection_dims(pca_.dims());
+	for (auto images : sets)
+	{
+		for (auto id : *images)
+		{
+			if (store_.has_hist(id))
+			{
+				pca_.project(store_.bins(id), store_.pixel_count(id), 
+							 store_.projection(id));
+			}
+		}
+	}
+	return true;
+}
+
+bool
+image_matcher::pca_screen(image_id a, image_id b) const
+{
+	if (!pca_.is_valid())
+	{
+		return false;
+	}
+	return hist_pca::screen_dist(store_.projection(a), store_.projection(b), 
+								 pca_.dims())
+			> match_threshold_ * pca_tolerance_;
+}
+
+void
+image_matcher::report_reading() const
+{
+	if (verbose_ > 0 && uses_probe())
+	{
+		std::cout << "header probe rejected " << probe_rejected_ << " of " 
+				<< probed_ << " images without decoding them" << std::endl;
+	}
+
+	if (verbose_ > 0 && files_read_ > 0 && io_seconds_ > 0.0)
+	{
+		double megabytes = bytes_read_ / (1024.0 * 1024.0);
+		std::cout << "read " << files_read_ << " image files (" 
+				<< megabytes << " MB) in " << io_seconds_ << " s of I/O: "
+				<< megabytes / io_seconds_ << " MB/s, " 
+				<< files_read_ / io_seconds_ << " files/s" << std::endl;
+	}
+	if (verbose_ > 0 && files_read_ > 0 && build_seconds_ > 0.0)
+	{
+		double megabytes = bytes_read_ / (1024.0 * 1024.0);
+		std::cout << "built histograms in " << build_seconds_ 
+				<< " s overall, including decoding: " 
+				<< megabytes / build_seconds_ << " MB/s, " 
+				<< files_read_ / build_seconds_ << " files/s" << std::endl;
+	}
+}
+
+void
+image_matcher::report_screening() const
+{
+	if (verbose_ > 0 && use_buckets())
+	{
+		std::cout << "fingerprint buckets produced " << comparisons_ 
+				<< " candidate comparisons" << std::endl;
+	}
+	if (verbose_ > 0 && pca_.is_valid())
+	{
+		std::cout << "pca screening rejected " << pca_screened_ << " of " 
+				<< comparisons_ << " comparisons" << std::endl;
+	}
+	if (verbose_ > 0 && store_.has_screen())
+	{
+		std::cout << hist_geometry_name(store_.screen_geometry()) 
+				<< "-bin histogram screening rejected " << hist_screened_ 
+				<< " of " << comparisons_ - pca_screened_ << " comparisons" 
+				<< std::endl;
+	}
+}
+
+bool
+image_matcher::add_path(fs::path const& p, image_id& id)
+{
+	if (!paths_.insert(p, id))
+	{
+		return false;
+	}
+	store_.resize(paths_.size());
+	match_sums_.push_back(match_sums{0.0, 0});
+	return true;
+}
+
+bool
+image_matcher::add_image_file(fs::path const& path, image_set& images)
+{
+	if (limit_ >= 0 && paths_.size() >= limit_)
+	{
+		std::cout << "image count limit reached" << std::endl;
+		return false;
+	}
+	if (verbose_ > 1)
+	{
+		std::cout << "found image file: "
+				<< path.filename() << std::endl;
+	}
+	image_id id;
+	if (add_path(path, id) && !find_alias(id) && passes_probe(id))
+	{
+		if (verbose_ > 1)
+		{
+			std::cout << "building histogram for "
+					<< path.filename() << std::endl;
+		}
+		else if (verbose_ == 1)
+		{
+			std::cout << ".";
+			std::cout.flush();
+		}
+		if (read_mode_ != read_mode::file)
+		{
+			queue_histogram(id, images);
+		}
+		else
+		{
+			build_histogram(id, images);
+			finish_histogram(id);
+		}
+	}
+	return true;
+}
+
+void
+image_matcher::queue_histogram(image_id id, image_set& images)
+{
+	/*
+	 * images that will come from the catalog aren't read; the rest are 
+	 * read ahead (or, when prefetching, the kernel is asked to read them
+	 * ahead), and built once read_depth_ more are on their way
+	 */
+	fs::path const& p = path_of(id);
+	bool cataloged = false;
+	if (uses_catalog())
+	{
+		boost::system::error_code ec;
+		std::uint64_t file_size = fs::file_size(p, ec);
+		std::time_t mtime = fs::last_write_time(p, ec);
+		cataloged = !ec && catalog_.contains(p, file_size, mtime);
+	}
+	if (!cataloged && reader_.is_open())
+	{
+		reader_.submit(p.string());
+	}
+	else if (!cataloged)
+	{
+		file_reader::prefetch(p.string());
+	}
+	queued_.push_back(queued_image{id, &images, !cataloged && reader_.is_open()});
+	if (queued_.size() > read_depth_)
+	{
+		build_queued_histogram();
+	}
+}
+
+void
+image_matcher::build_queued_histogram()
+{
+	queued_image queued = queued_.front();
+	queued_.pop_front();
+	if (!queued.read)
+	{
+		build_histogram(queued.id, *queued.images);
+	}
+	else
+	{
+		std::vector<unsigned char> contents;
+		int error = 0;
+		auto start = std::chrono::steady_clock::now();
+		reader_.next(contents, error);
+		io_seconds_ += std::chrono::duration<double> (
+				std::chrono::steady_clock::now() - start).count();
+		if (error != 0)
+		{
+			if (verbose_ == 1) std::cout << std::endl;
+			std::cerr << "error: couldn't read " << path_of(queued.id)
+					<< ", error code message: " << std::strerror(error) 
+					<< std::endl;
+		}
+		else
+		{
+			build_histogram(queued.id, *queued.images, &contents);
+		}
+	}
+	finish_histogram(queued.id);
+}
+
+void
+image_matcher::finish_histogram(image_id id)
+{
+	if (drop_cache_)
+	{
+		file_reader::drop(path_of(id).string());
+	}
+	/*
+	 * some ids never get here (targets, aliases, rejects, copies, failed 
+	 * reads), so every whole block below this one is released, not just
+	 * the one that ends here
+	 */
+	if (store_.is_spilled())
+	{
+		std::size_t block_rows = spill_block_rows();
+		std::size_t end = (static_cast<std::size_t> (id) + 1) / block_rows * block_rows;
+		if (end > released_rows_)
+		{
+			store_.release(static_cast<image_id> (released_rows_), 
+						   static_cast<image_id> (end));
+			released_rows_ = end;
+		}
+	}
+}
+
+void
+image_matcher::build_queued_histograms()
+{
+	while (!queued_.empty())
+	{
+		build_queued_histogram();
+	}
+}
+
+void
+image_matcher::build_histograms(fs::path const& dir, image_set& images)
+{
+	fs::directory_iterator end_iter;
+
+	if (verbose_ > 0)
+	{
+		std::cout << "building histograms for image files in "
+				<< dir << ":" << std::endl;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (recursive_ || read_order_ != file_order::listed)
+	{
+		std::vector<fs::path> files;
+		collect_image_files(dir, files);
+		std::size_t located = order_files(files, read_order_);
+		if (verbose_ > 0 && read_order_ == file_order::physical)
+		{
+			std::cout << "found the physical location of " << located 
+					<< " of " << files.size() << " image files" << std::endl;
+		}
+		for (auto const& path : files)
+		{
+			try
+			{
+				if (!add_image_file(path, images))
+				{
+					break;
+				}
+			}
+			catch (const std::exception & ex)
+			{
+				std::cerr << "error: '" << path.filename() << "' "
+						<< ex.what() << std::endl;
+			}
+		}
+	}
+	else
+	{
+		for (fs::directory_iterator dir_itr(dir);
+			dir_itr != end_iter;
+			++dir_itr)
+		{
+			try
+			{
+				fs::path canonical_path(fs::canonical(dir_itr->path()));
+				if (fs::is_regular_file(canonical_path)
+					&& (is_image_file(canonical_path))
+					&& !add_image_file(canonical_path, images))
+				{
+					break;
+				}
+			}
+			catch (const std::exception & ex)
+			{
+				std::cerr << "error: '" << dir_itr->path().filename() << "' "
+						<< ex.what() << std::endl;
+			}
+		}
+	}
+	build_queued_histograms();
+	build_seconds_ += std::chrono::duration<double> (
+			std::chrono::steady_clock::now() - start).count();
+	if (verbose_ == 1)
+	{
+		std::cout << std::endl;
+	}
+}
+
+template <class Visit>
+void
+image_matcher::for_each_listed_file(Visit visit)
+{
+	std::ifstream list_file;
+	if (files_from_ != "-")
+	{
+		list_file.open(files_from_, std::ios::binary);
+		if (!list_file)
+		{
+			std::cerr << "error: can't open file list " << files_from_ 
+					<< std::endl;
+			return;
+		}
+	}
+
+	/*
+	 * listed paths are taken as they are, rather than resolved with 
+	 * canonical(), which costs a round trip per path component on a network
+	 * mount
+	 */
+	fs::path cwd(fs::current_path());
+	file_list_reader reader(files_from_ == "-" ? std::cin : list_file);
+	std::string entry;
+	while (reader.next(entry))
+	{
+		try
+		{
+			fs::path path(fs::absolute(fs::path(entry), cwd).lexically_normal());
+			if (is_image_file(path) && !visit(path))
+			{
+				break;
+			}
+		}
+		catch (const std::exception & ex)
+		{
+			std::cerr << "error: '" << entry << "' " << ex.what() << std::endl;
+		}
+	}
+}
+
+void
+image_matcher::build_listed_histograms(image_set& images)
+{
+	if (verbose_ > 0)
+	{
+		std::cout << "building histograms for image files listed in "
+				<< (files_from_ == "-" ? "standard input" : files_from_) 
+				<< ":" << std::endl;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for_each_listed_file([&](fs::path const& path)
+	{
+		return add_image_file(path, images);
+	});
+
+	build_queued_histograms();
+	build_seconds_ += std::chrono::duration<double> (
+			std::chrono::steady_clock::now() - start).count();
+	if (verbose_ == 1)
+	{
+		std::cout << std::endl;
+	}
+}
+
+void image_matcher::find_matches(image_set const& targets, 
+								 image_set const& search)
+{
+	if (use_buckets())
+	{
+		find_matches_by_bucket(targets, search);
+		return;
+	}
+
+	/*
+	 * without any per-pair screening, every distance has to be calculated,
+	 * so use the cache-blocked kernel
+	 */
+	if (!pca_.is_valid() && !store_.has_screen())
+	{
+		find_matches_blocked(targets, search);
+		return;
+	}
+
+	for (auto target : targets)
+	{
+		for (auto candidate : search)
+		{
+			compare(target, candidate);
+		}
+	}
+}
+
+void image_matcher::find_matches_blocked(image_set const& targets, 
+										 image_set const& search)
+{
+	hist_matrix target_matrix(store_.bin_count());
+	hist_matrix search_matrix(store_.bin_count());
+
+	for (auto id : targets)
+	{
+		target_matrix.append(store_.bins(id), store_.pixel_count(id));
+	}
+	for (auto id : search)
+	{
+		search_matrix.append(store_.bins(id), store_.pixel_count(id));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	blocked_chi_sqr_dists(target_matrix, search_matrix,
+		[&](std::size_t t, std::size_t s, double distance)
+		{
+			if (targets[t] != search[s])
+			{
+				++comparisons_;
+				poll_results();
+				record_distance(targets[t], search[s], distance);
+			}
+		});
+
+	std::chrono::duration<double> elapsed = 
+			std::chrono::steady_clock::now() - start;
+	if (verbose_ > 0)
+	{
+		std::size_t pairs = targets.size() * search.size();
+		std::cout << "compared " << targets.size() << " targets with " 
+				<< search.size() << " images in " << elapsed.count() 
+				<< " seconds";
+		if (elapsed.count() > 0.0)
+		{
+			std::cout << " (" << static_cast<std::size_t> (pairs / elapsed.count()) 
+					<< " comparisons per second)";
+		}
+		std::cout << std::endl;
+	}
+}
+
+void image_matcher::find_nearest(image_set const& targets, 
+								 image_set const& search)
+{
+	std::size_t cut_short = 0ul;
+
+	for (auto target : targets)
+	{
+		ranked_heap heap;
+
+		for (auto candidate : search)
+		{
+			if (target == candidate)
+			{
+				continue;
+			}
+			++comparisons_;
+			poll_results();
+
+			/*
+			 * once the heap is full, only images nearer than the worst 
+			 * match in the heap matter
+			 */
+			bool full = heap.size() == top_k_;
+			double bound = full ? heap.top().distance 
+					: std::numeric_limits<double>::infinity();
+
+			if (full && pca_.is_valid()
+				&& hist_pca::screen_dist(store_.projection(target),
+										 store_.projection(candidate),
+										 pca_.dims()) > bound * pca_tolerance_)
+			{
+				++pca_screened_;
+				continue;
+			}
+			if (full && store_.has_screen()
+				&& store_.screen_dist(target, candidate, bound) > bound)
+			{
+				++hist_screened_;
+				continue;
+			}
+
+			auto distance = store_.chi_sqr_dist(target, candidate, bound);
+			if (distance > bound)
+			{
+				++cut_short;
+				continue;
+			}
+			if (verbose_ > 1)
+			{
+				std::cout << "compared " << path_of(target) << " with "
+						<< path_of(candidate) << ": " << distance << std::endl;
+			}
+
+			ranked_match match{distance, candidate};
+			if (!full)
+			{
+				heap.push(match);
+			}
+			else if (match < heap.top())
+			{
+				heap.pop();
+				heap.push(match);
+			}
+		}
+
+		ranked_list list(heap.size());
+		for (auto i = list.size(); i > 0; --i)
+		{
+			list[i - 1] = heap.top();
+			heap.pop();
+		}
+		add_nearest_duplicates(list);
+		ranked_lists_.emplace_back(target, std::move(list));
+	}
+
+	// byte-identical copies of targets have the same nearest matches
+	auto list_count = ranked_lists_.size();
+	for (auto const& dup : duplicates_)
+	{
+		for (auto i = 0ul; i < list_count; ++i)
+		{
+			if (ranked_lists_[i].first == dup.original)
+			{
+				ranked_lists_.emplace_back(dup.id, ranked_lists_[i].second);
+				break;
+			}
+		}
+	}
+
+	std::sort(ranked_lists_.begin(), ranked_lists_.end(),
+			  [this](std::pair<image_id, ranked_list> const& a,
+					 std::pair<image_id, ranked_list> const& b)
+			  {
+				  return paths_.less(a.first, b.first);
+			  });
+
+	if (verbose_ > 0)
+	{
+		std::cout << "top-" << top_k_ << " bound cut short " << cut_short 
+				<< " of " << comparisons_ << " distance calculations" << std::endl;
+	}
+}
+
+void image_matcher::add_nearest_duplicates(ranked_list& list) const
+{
+	if (duplicates_.empty())
+	{
+		return;
+	}
+
+	/*
+	 * byte-identical copies are as near as their originals; rank them
+	 * right after the originals
+	 */
+	ranked_list expanded;
+	for (auto const& match : list)
+	{
+		expanded.push_back(match);
+		for (auto const& dup : duplicates_)
+		{
+			if (dup.original == match.id)
+			{
+				expanded.push_back(ranked_match{match.distance, dup.id});
+			}
+		}
+	}
+	if (expanded.size() > top_k_)
+	{
+		expanded.resize(top_k_);
+	}
+	list = std::move(expanded);
+}
+
+void image_matcher::generate_ranked_lists()
+{
+	std::size_t list_count = 0ul;
+
+	for (auto const& ranked : ranked_lists_)
+	{
+		std::cout << "nearest matches for " << path_of(ranked.first) << ":" 
+				<< std::endl;
+		for (auto i = 0ul; i < ranked.second.size(); ++i)
+		{
+			std::cout << "    " << (i + 1) << ". " << path_of(ranked.second[i].id) 
+					<< " " << ranked.second[i].distance << std::endl;
+			if (results_.is_open())
+			{
+				results_.write_nearest(path_of(ranked.first), i + 1, 
+									   path_of(ranked.second[i].id), 
+									   ranked.second[i].distance);
+			}
+		}
+		if (!ranked.second.empty())
+		{
+			++list_count;
+		}
+	}
+
+	results_.flush();
+
+	if (list_count == 0)
+	{
+		std::cout << "no matches found" << std::endl;
+		return;
+	}
+
+	if (!fs::exists(results_path_))
+	{
+		if (!create_dir(results_path_)) return;
+	}
+
+	link_writer links;
+	if (!links.open(results_path_)) return;
+
+	/*
+	 * one directory per target; link names are prefixed with their rank,
+	 * and the target itself is rank 0
+	 */
+	std::size_t set_index = 0ul;
+	for (auto const& ranked : ranked_lists_)
+	{
+		if (ranked.second.empty())
+		{
+			continue;
+		}
+		std::vector<image_id> ids{ranked.first};
+		std::vector<double> distances{0.0};
+		for (auto const& match : ranked.second)
+		{
+			ids.push_back(match.id);
+			distances.push_back(match.distance);
+		}
+		add_matching_links(links, ids, distances, set_index++, true);
+	}
+	links.write();
+	
+	std::cout << list_count << " ranked lists were generated" << std::endl;
+}
+
+bool
+image_matcher::load_pair_cache()
+{
+	if (uses_catalog())
+	{
+		/* loaded with the catalog */
+		return true;
+	}
+	if (pair_cache_path_.empty() || use_target_)
+	{
+		return false;
+	}
+	if (fs::exists(pair_cache_path_) 
+		&& !pair_cache_.load(pair_cache_path_.string(), store_.geometry()))
+	{
+		std::cerr << "warning: could not load pair cache from " 
+				<< pair_cache_path_ << ", comparing every pair" << std::endl;
+	}
+	return true;
+}
+
+void
+image_matcher::save_pair_cache() const
+{
+	if (uses_catalog())
+	{
+		if (!catalog_.save(catalog_path_.string(), store_, paths_, pair_cache_))
+		{
+			std::cerr << "warning: could not save catalog to " 
+					<< catalog_path_ << std::endl;
+			return;
+		}
+	}
+	else if (!pair_cache_.save(pair_cache_path_.string(), store_.geometry()))
+	{
+		std::cerr << "warning: could not save pair cache to " 
+				<< pair_cache_path_ << std::endl;
+		return;
+	}
+	if (verbose_ > 0)
+	{
+		if (uses_catalog())
+		{
+			std::cout << "catalog supplied " << catalog_.fetched()
+					<< " histograms without decoding images" << std::endl;
+		}
+		std::cout << "pair cache supplied " << cached_pairs_ 
+				<< " pairs without comparing them" << std::endl;
+	}
+}
+
+void
+image_matcher::watch(std::vector<image_set>& scopes)
+{
+	dir_watcher watcher;
+	if (!watcher.open(search_paths_))
+	{
+		return;
+	}
+
+	std::cout << "watching " << search_paths_.size() 
+			<< (search_paths_.size() == 1 ? " directory" : " directories")
+			<< " for new images" << std::endl;
+
+	/*
+	 * each batch is matched against itself and against the images already
+	 * in its scope -- all of the search directories with exhaustive search,
+	 * otherwise just its own directory
+	 */
+	watching_ = true;
+	std::vector<watch_event> events;
+	bool rescan = false;
+	while (watcher.wait(events, rescan))
+	{
+		std::vector<image_set> batches(scopes.size());
+		std::size_t duplicate_count = duplicates_.size();
+
+		for (auto i = 0ul; i < search_paths_.size() && rescan; ++i)
+		{
+			scope_ = (exhaustive_ ? 0 : i) + 1;
+			build_histograms(search_paths_[i], batches[scope_ - 1]);
+		}
+		for (auto const& event : events)
+		{
+			scope_ = (exhaustive_ ? 0 : event.dir) + 1;
+			watch_file(event.path, scopes[scope_ - 1], batches[scope_ - 1]);
+		}
+
+		std::size_t batch_total = 0;
+		for (auto s = 0ul; s < scopes.size(); ++s)
+		{
+			image_set& batch = batches[s];
+			if (batch.empty())
+			{
+				continue;
+			}
+			if (pca_.is_valid())
+			{
+				for (auto id : batch)
+				{
+					pca_.project(store_.bins(id), store_.pixel_count(id), 
+								 store_.projection(id));
+				}
+			}
+			find_matches(batch);
+			find_matches(batch, scopes[s]);
+			scopes[s].insert(scopes[s].end(), batch.begin(), batch.end());
+			batch_total += batch.size();
+		}
+
+		for (auto d = duplicate_count; d < duplicates_.size(); ++d)
+		{
+			std::cout << "found byte-identical copy -- " 
+					<< path_of(duplicates_[d].original) << " and " 
+					<< path_of(duplicates_[d].id) << std::endl;
+		}
+		if (verbose_ > 0)
+		{
+			std::cout << "matched " << batch_total << " new images" << std::endl;
+		}
+		if (results_.is_open())
+		{
+			results_.flush();
+		}
+	}
+	watching_ = false;
+
+	std::cout << "stopped watching" << std::endl;
+	if (uses_catalog())
+	{
+		save_pair_cache();
+	}
+}
+
+void
+image_matcher::watch_file(fs::path const& path, image_set& scope, image_set& batch)
+{
+	try
+	{
+		if (!fs::exists(path))
+		{
+			/* moved away or deleted again before the batch was read */
+			return;
+		}
+		fs::path canonical_path(fs::canonical(path));
+		if (!fs::is_regular_file(canonical_path) || !is_image_file(canonical_path))
+		{
+			return;
+		}
+		image_id id;
+		if (!add_path(canonical_path, id))
+		{
+			/*
+			 * a file that was rewritten gets a new histogram and is matched
+			 * again; the matches it already had are kept
+			 */
+			auto it = std::find(scope.begin(), scope.end(), id);
+			if (it != scope.end())
+			{
+				scope.erase(it);
+			}
+			else if (std::find(batch.begin(), batch.end(), id) != batch.end())
+			{
+				return;
+			}
+			forget_file(id);
+		}
+		if (find_alias(id) || !passes_probe(id))
+		{
+			return;
+		}
+		if (verbose_ > 1)
+		{
+			std::cout << "building histogram for " 
+					<< canonical_path.filename() << std::endl;
+		}
+		build_histogram(id, batch);
+	}
+	catch (const std::exception & ex)
+	{
+		std::cerr << "error: '" << path.filename() << "' " 
+				<< ex.what() << std::endl;
+	}
+}
+
+void
+image_matcher::walk_image_files(fs::path const& dir, 
+								std::vector<fs::path>& files) const
+{
+	dir_walker walker([this](std::string const& name)
+	{
+		return is_image_file(fs::path(name));
+	});
+	walker.walk(dir, files);
+}
+
+void
+image_matcher::collect_image_files(fs::path const& dir, 
+								   std::vector<fs::path>& files)
+{
+	if (recursive_)
+	{
+		walk_image_files(dir, files);
+		return;
+	}
+	fs::directory_iterator end_iter;
+	for (fs::directory_iterator dir_itr(dir);
+		dir_itr != end_iter;
+		++dir_itr)
+	{
+		try
+		{
+			fs::path canonical_path(fs::canonical(dir_itr->path()));
+			if (fs::is_regular_file(canonical_path)
+				&& (is_image_file(canonical_path)))
+			{
+				files.push_back(canonical_path);
+			}
+		}
+		catch (const std::exception & ex)
+		{
+			std::cerr << "error: '" << dir_itr->path().filename() << "' "
+					<< ex.what() << std::endl;
+		}
+	}
+}
+
+void
+image_matcher::collect_listed_files(std::vector<fs::path>& files)
+{
+	for_each_listed_file([&](fs::path const& path)
+	{
+		files.push_back(path);
+		return true;
+	});
+}
+
+void
+image_matcher::match_shard()
+{
+	/*
+	 * Every shard lists the same files in the same order, divides them 
+	 * into blocks, and takes its share of the tiles of the upper triangle 
+	 * of the block-by-block pair space, in row-major order. A shard only
+	 * decodes the blocks its tiles touch. There are about four tiles per
+	 * shard, so the shares come out even.
+	 */
+	std::vector<fs::path> files;
+	for (auto const& dir : search_paths_)
+	{
+		collect_image_files(dir, files);
+	}
+	if (has_file_list())
+	{
+		collect_listed_files(files);
+	}
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+	if (limit_ >= 0 && files.size() > static_cast<std::size_t> (limit_))
+	{
+		files.resize(limit_);
+	}
+
+	std::size_t file_count = files.size();
+	std::size_t block_count = 1;
+	while (block_count * (block_count + 1) / 2 < 4 * shard_count_)
+	{
+		++block_count;
+	}
+	block_count = std::max<std::size_t> (1, std::min(block_count, file_count));
+	std::size_t tile_count = block_count * (block_count + 1) / 2;
+	std::size_t first_tile = shard_ * tile_count / shard_count_;
+	std::size_t last_tile = (shard_ + 1) * tile_count / shard_count_;
+
+	std::vector<std::pair<std::size_t, std::size_t>> tiles;
+	std::vector<bool> needed(block_count, false);
+	std::size_t tile = 0;
+	for (auto p = 0ul; p < block_count; ++p)
+	{
+		for (auto q = p; q < block_count; ++q, ++tile)
+		{
+			if (tile >= first_tile && tile < last_tile)
+			{
+				tiles.emplace_back(p, q);
+				needed[p] = true;
+				needed[q] = true;
+			}
+		}
+	}
+
+	if (verbose_ > 0)
+	{
+		std::cout << "shard " << shard_ + 1 << " of " << shard_count_ 
+				<< " takes " << tiles.size() << " of " << tile_count 
+				<< " tiles of " << file_count << " images" << std::endl;
+	}
+
+	std::vector<image_set> blocks(block_count);
+	std::vector<image_set const*> block_ptrs;
+	for (auto b = 0ul; b < block_count; ++b)
+	{
+		if (!needed[b])
+		{
+			continue;
+		}
+		scope_ = b + 1;
+		for (auto i = b * file_count / block_count; 
+			 i < (b + 1) * file_count / block_count; 
+			 ++i)
+		{
+			image_id id;
+			if (add_path(files[i], id))
+			{
+				if (verbose_ > 1)
+				{
+					std::cout << "building histogram for "
+							<< files[i].filename() << std::endl;
+				}
+				build_histogram(id, blocks[b]);
+			}
+		}
+		block_ptrs.push_back(&blocks[b]);
+	}
+
+	if (use_pca() && !prepare_pca(block_ptrs))
+	{
+		return;
+	}
+
+	for (auto const& t : tiles)
+	{
+		if (t.first == t.second)
+		{
+			find_matches(blocks[t.first]);
+		}
+		else
+		{
+			find_matches(blocks[t.first], blocks[t.second]);
+		}
+	}
+	report_reading();
+	report_aliases();
+	report_screening();
+
+	/*
+	 * a byte-identical copy wasn't compared, so it's recorded as a match 
+	 * of its original
+	 */
+	edge_file edges;
+	edges.set_shard(shard_, shard_count_);
+	edges.set_threshold(match_threshold_);
+	for (auto const& dup : duplicates_)
+	{
+		if (store_.has_hist(dup.original))
+		{
+			edges_.push_back(match_edge{dup.original, dup.id, 0.0});
+		}
+	}
+	for (auto const& edge : edges_)
+	{
+		edges.add_edge(edges.add_path(path_of(edge.a).string()), 
+					   edges.add_path(path_of(edge.b).string()), 
+					   edge.distance);
+	}
+
+	if (!fs::exists(results_path_) && !create_dir(results_path_))
+	{
+		return;
+	}
+	std::ostringstream name;
+	name << "shard-" << shard_ + 1 << "-of-" << shard_count_ << ".edges";
+	fs::path edge_path = results_path_ / name.str();
+	if (!edges.save(edge_path.string()))
+	{
+		std::cerr << "error: could not write edge file " << edge_path 
+				<< std::endl;
+		return;
+	}
+	std::cout << edges_.size() << " matches were written to " << edge_path 
+			<< std::endl;
+}
+
+void
+image_matcher::merge_shards()
+{
+	std::size_t shard_count = 0;
+	std::vector<bool> have_shard;
+	double threshold = std::numeric_limits<double>::infinity();
+	double loosest_threshold = 0.0;
+	std::vector<match_edge> merged;
+
+	for (auto const& merge_path : merge_paths_)
+	{
+		edge_file edges;
+		if (!edges.load(merge_path.string()))
+		{
+			std::cerr << "error: could not read edge file " << merge_path 
+					<< std::endl;
+			return;
+		}
+		if (shard_count == 0)
+		{
+			shard_count = edges.shard_count();
+			have_shard.assign(shard_count, false);
+		}
+		else if (edges.shard_count() != shard_count)
+		{
+			std::cerr << "error: edge file " << merge_path << " is from a "
+					<< "search with " << edges.shard_count() << " shards, not "
+					<< shard_count << std::endl;
+			return;
+		}
+		have_shard[edges.shard()] = true;
+		threshold = std::min(threshold, edges.threshold());
+		loosest_threshold = std::max(loosest_threshold, edges.threshold());
+
+		std::vector<image_id> ids;
+		ids.reserve(edges.paths().size());
+		for (auto const& path_string : edges.paths())
+		{
+			image_id id;
+			add_path(fs::path(path_string), id);
+			ids.push_back(id);
+		}
+		for (auto const& e : edges.edges())
+		{
+			image_id a = std::min(ids[e.a], ids[e.b]);
+			image_id b = std::max(ids[e.a], ids[e.b]);
+			merged.push_back(match_edge{a, b, e.distance});
+		}
+	}
+
+	std::size_t shard_total = std::count(have_shard.begin(), have_shard.end(), true);
+	if (shard_total < shard_count)
+	{
+		std::cerr << "warning: edge files cover " << shard_total << " of " 
+				<< shard_count << " shards, some matches will be missing" 
+				<< std::endl;
+	}
+
+	/*
+	 * the sets can only be as loose as the tightest shard's search
+	 */
+	if (loosest_threshold > threshold)
+	{
+		std::cerr << "warning: shards were searched with match thresholds from "
+				<< threshold << " to " << loosest_threshold << ", merging at " 
+				<< threshold << std::endl;
+		merged.erase(std::remove_if(merged.begin(), merged.end(),
+									[threshold](match_edge const& edge)
+									{
+										return edge.distance > threshold;
+									}),
+					 merged.end());
+	}
+
+	/*
+	 * a copy can be matched with its original by several shards
+	 */
+	std::sort(merged.begin(), merged.end(), 
+			  [](match_edge const& x, match_edge const& y)
+			  {
+				  return x.a < y.a || (x.a == y.a && x.b < y.b);
+			  });
+	merged.erase(std::unique(merged.begin(), merged.end(),
+							 [](match_edge const& x, match_edge const& y)
+							 {
+								 return x.a == y.a && x.b == y.b;
+							 }),
+				 merged.end());
+
+	if (thresholds_.empty())
+	{
+		match_threshold_ = threshold;
+		for (auto const& edge : merged)
+		{
+			add_match(edge.a, edge.b, edge.distance);
+		}
+	}
+	else
+	{
+		if (match_threshold_ > threshold)
+		{
+			std::cerr << "warning: shards were searched with match threshold "
+					<< threshold << ", looser thresholds will miss matches" 
+					<< std::endl;
+		}
+		edges_ = std::move(merged);
+	}
+
+	/*
+	 * only the images that matched need histograms, for the distances from
+	 * each set's medoid; copies are decoded like any other image
+	 */
+	hash_duplicates_ = false;
+	image_set matched;
+	for (image_id id = 0; id < paths_.size(); ++id)
+	{
+		build_histogram(id, matched);
+	}
+	if (verbose_ > 0)
+	{
+		std::cout << "merged " << merge_paths_.size() << " edge files with "
+				<< paths_.size() << " matching images" << std::endl;
+	}
+
+	generate_results();
+}
+
+void
+image_matcher::load_catalog()
+{
+	if (fs::exists(catalog_path_) 
+		&& !catalog_.load(catalog_path_.string(), store_.geometry(), pair_cache_))
+	{
+		std::cerr << "warning: could not load catalog from " 
+				<< catalog_path_ << ", matching every image" << std::endl;
+		catalog_ = image_catalog();
+		pair_cache_ = pair_cache();
+	}
+	else if (verbose_ > 0)
+	{
+		std::cout << "catalog holds " << catalog_.size() << " images" 
+				<< std::endl;
+	}
+}
+
+void image_matcher::find_matches_spilled(image_set const& images)
+{
+	/*
+	 * A block nested loop join: the images are divided into blocks small
+	 * enough that two of them fit in the memory budget, and each block is
+	 * joined with itself and with each later block. Blocks are released 
+	 * once they've been used, so at most two are resident at a time.
+	 */
+	std::size_t block_rows = spill_block_rows();
+	std::vector<image_set> blocks;
+	for (auto i = 0ul; i < images.size(); i += block_rows)
+	{
+		blocks.emplace_back(images.begin() + i, 
+							images.begin() + std::min(i + block_rows, images.size()));
+	}
+
+	auto release = [this](image_set const& block)
+	{
+		auto range = std::minmax_element(block.begin(), block.end());
+		store_.release(*range.first, *range.second + 1);
+	};
+
+	if (verbose_ > 0)
+	{
+		std::cout << "histograms were spilled to disk, joining " 
+				<< images.size() << " images in " << blocks.size() 
+				<< " blocks" << std::endl;
+	}
+
+	for (auto p = 0ul; p < blocks.size(); ++p)
+	{
+		find_matches(blocks[p]);
+		for (auto q = p + 1; q < blocks.size(); ++q)
+		{
+			find_matches(blocks[p], blocks[q]);
+			release(blocks[q]);
+		}
+		release(blocks[p]);
+	}
+}
+
+void image_matcher::find_matches_cached(image_set const& images)
+{
+	/*
+	 * Images are grouped by the cached clique they belong to; pairs within
+	 * a group were already compared, at this threshold or a looser one. 
+	 * Their matches are replayed from the cache, and only pairs that span
+	 * groups or include an image that isn't in the cache are compared.
+	 */
+	std::vector<image_set> groups(1);
+	std::unordered_map<std::uint32_t, std::size_t> group_index;
+	std::unordered_map<std::uint64_t, std::vector<image_id>> cached_ids;
+	std::vector<std::uint64_t> fingerprints;
+	fingerprints.reserve(images.size());
+
+	for (auto id : images)
+	{
+		auto fingerprint = store_.fingerprint(id);
+		fingerprints.push_back(fingerprint);
+		auto clique = pair_cache_.clique_of(fingerprint, match_threshold_);
+		if (clique == 0)
+		{
+			groups[0].push_back(id);
+			continue;
+		}
+		auto index = group_index.emplace(clique, groups.size());
+		if (index.second)
+		{
+			groups.emplace_back();
+		}
+		groups[index.first->second].push_back(id);
+		cached_ids[fingerprint].push_back(id);
+	}
+
+	// images with the same fingerprint have identical histograms
+	for (auto const& entry : cached_ids)
+	{
+		auto const& ids = entry.second;
+		for (auto i = 0ul; i < ids.size(); ++i)
+		{
+			for (auto j = i + 1; j < ids.size(); ++j)
+			{
+				record_distance(ids[i], ids[j], 0.0);
+			}
+		}
+	}
+
+	pair_cache_.visit_matches(match_threshold_,
+		[&](std::uint64_t a, std::uint64_t b, double distance)
+		{
+			auto a_ids = cached_ids.find(a);
+			auto b_ids = cached_ids.find(b);
+			if (a_ids == cached_ids.end() || b_ids == cached_ids.end()
+				|| pair_cache_.clique_of(a, match_threshold_) 
+					!= pair_cache_.clique_of(b, match_threshold_))
+			{
+				return;
+			}
+			pair_cache_.add_match(a, b, distance);
+			for (auto a_id : a_ids->second)
+			{
+				for (auto b_id : b_ids->second)
+				{
+					report_match(a_id, b_id, distance);
+				}
+			}
+		});
+
+	find_matches(groups[0]);
+	for (auto k = 1ul; k < groups.size(); ++k)
+	{
+		cached_pairs_ += groups[k].size() * (groups[k].size() - 1) / 2;
+		find_matches(groups[0], groups[k]);
+		for (auto l = k + 1; l < groups.size(); ++l)
+		{
+			find_matches(groups[k], groups[l]);
+		}
+	}
+
+	pair_cache_.add_clique(match_threshold_, std::move(fingerprints));
+}
+
+void image_matcher::find_matches(image_set const& images)
+{
+	if (use_buckets())
+	{
+		find_matches_by_bucket(images);
+		return;
+	}
+
+	for (auto i = 0ul; i < images.size(); ++i)
+	{
+		for (auto j = i + 1; j < images.size(); ++j)
+		{
+			compare(images[i], images[j]);
+		}
+	}
+}
+
+void
+image_matcher::bucket_keys(image_id id, 
+						   std::uint64_t& key, 
+						   std::vector<std::uint64_t>* probes) const
+{
+	if (match_threshold_ == 0.0)
+	{
+		/*
+		 * only identical normalized histograms can match
+		 */
+		key = store_.fingerprint(id);
+		if (probes)
+		{
+			probes->assign(1, key);
+		}
+		return;
+	}
+
+	/*
+	 * The square roots of the octant masses of matching histograms differ by
+	 * no more than sqrt(threshold / 2) in each dimension. With cells twice 
+	 * that wide, a match is either in the same cell, or in the neighboring 
+	 * cell on the side nearest the value, so probing every combination of
+	 * the cell and its nearest neighbor in each dimension finds all of them.
+	 */
+	static constexpr std::size_t dims = octant_count;
+
+	std::array<double, dims> masses;
+	store_.octant_masses(id, masses);
+	double cell_width = 2.0 * std::sqrt(match_threshold_ / 2.0) * (1.0 + 1.0e-9);
+
+	std::array<std::int64_t, dims> cells;
+	std::array<std::int64_t, dims> nearest;
+	for (auto k = 0ul; k < dims; ++k)
+	{
+		double position = std::sqrt(masses[k]) / cell_width;
+		double cell = std::floor(position);
+		cells[k] = static_cast<std::int64_t> (cell);
+		nearest[k] = (position - cell < 0.5) ? cells[k] - 1 : cells[k] + 1;
+	}
+	key = hash_bytes(cells.data(), sizeof (cells));
+
+	if (probes)
+	{
+		probes->clear();
+		std::array<std::int64_t, dims> probe;
+		for (auto combination = 0ul; combination < (1ul << dims); ++combination)
+		{
+			for (auto k = 0ul; k < dims; ++k)
+			{
+				probe[k] = (combination & (1ul << k)) ? nearest[k] : cells[k];
+			}
+			probes->push_back(hash_bytes(probe.data(), sizeof (probe)));
+		}
+		std::sort(probes->begin(), probes->end());
+		probes->erase(std::unique(probes->begin(), probes->end()), probes->end());
+	}
+}
+
+void
+image_matcher::fill_buckets(image_set const& images, 
+							image_set& items, 
+							bucket_map& buckets) const
+{
+	items.reserve(images.size());
+	for (auto id : images)
+	{
+		if (store_.has_hist(id))
+		{
+			std::uint64_t key;
+			bucket_keys(id, key, nullptr);
+			buckets[key].push_back(items.size());
+			items.push_back(id);
+		}
+	}
+}
+
+void image_matcher::find_matches_by_bucket(image_set const& images)
+{
+	image_set items;
+	bucket_map buckets;
+	fill_buckets(images, items, buckets);
+
+	std::vector<std::uint64_t> probes;
+	for (auto i = 0ul; i < items.size(); ++i)
+	{
+		std::uint64_t key;
+		bucket_keys(items[i], key, &probes);
+		for (auto probe : probes)
+		{
+			auto bucket = buckets.find(probe);
+			if (bucket == buckets.end())
+			{
+				continue;
+			}
+			for (auto j : bucket->second)
+			{
+				// every pair is found from both sides; compare it once
+				if (j > i)
+				{
+					compare(items[i], items[j]);
+				}
+			}
+		}
+	}
+}
+
+void image_matcher::find_matches_by_bucket(image_set const& targets, 
+										   image_set const& search)
+{
+	image_set items;
+	bucket_map buckets;
+	fill_buckets(search, items, buckets);
+
+	std::vector<std::uint64_t> probes;
+	for (auto target : targets)
+	{
+		if (!store_.has_hist(target))
+		{
+			continue;
+		}
+		std::uint64_t key;
+		bucket_keys(target, key, &probes);
+		for (auto probe : probes)
+		{
+			auto bucket = buckets.find(probe);
+			if (bucket == buckets.end())
+			{
+				continue;
+			}
+			for (auto j : bucket->second)
+			{
+				compare(target, items[j]);
+			}
+		}
+	}
+}
+
+void image_matcher::compare(image_id a, image_id b)
+{
+	if (a == b)
+	{
+		return;
+	}
+	++comparisons_;
+	poll_results();
+	if (pca_screen(a, b))
+	{
+		++pca_screened_;
+		return;
+	}
+	if (store_.has_screen() && store_.screen_dist(a, b) > match_threshold_)
+	{
+		++hist_screened_;
+		return;
+	}
+	auto distance = store_.chi_sqr_dist(a, b);
+	record_distance(a, b, distance);
+}
+
+void image_matcher::record_distance(image_id a, image_id b, double distance)
+{
+	if (verbose_ > 1)
+	{
+		std::cout << "compared " << path_of(a) << " with "
+				<< path_of(b) << ": " << distance << std::endl;
+	}
+	if (distance <= match_threshold_)
+	{
+		if ((!pair_cache_path_.empty() || uses_catalog()) 
+			&& store_.fingerprint(a) != store_.fingerprint(b))
+		{
+			pair_cache_.add_match(store_.fingerprint(a), store_.fingerprint(b), 
+								  distance);
+		}
+		report_match(a, b, distance);
+	}
+}
+
+void image_matcher::report_match(image_id a, image_id b, double distance)
+{
+	if (verbose_ > 0 || watching_)
+	{
+		std::cout << "found match -- " << path_of(a) << " and "
+				<< path_of(b) << ": " << distance << std::endl;
+	}
+	if (results_.is_open())
+	{
+		results_.write_match(path_of(a), path_of(b), distance);
+	}
+	if (!thresholds_.empty() || shard_count_ > 0)
+	{
+		edges_.push_back(match_edge{a, b, distance});
+	}
+	add_match(a, b, distance);
+}
+
+void image_matcher::add_match(image_id a, image_id b, double distance)
+{
+	match_sums_[a].sum_sq += distance * distance;
+	match_sums_[a].count++;
+	match_sums_[b].sum_sq += distance * distance;
+	match_sums_[b].count++;
+
+
+	auto a_match_set = match_set_map_.find(a);
+	auto b_match_set = match_set_map_.find(b);
+	if (is_end(a_match_set) && is_end(b_match_set))
+	{
+		match_set_ptr new_set = std::make_shared<match_set>();
+		new_set->push_back(a);
+		new_set->push_back(b);
+		match_set_map_.emplace(a, new_set);
+		match_set_map_.emplace(b, new_set);
+		match_sets_.insert(new_set);
+	}
+	else if (!is_end(a_match_set) && is_end(b_match_set))
+	{
+		match_set_map_.emplace(b, match_set_at(a_match_set));
+		match_set_at(a_match_set)->push_back(b);
+	}
+	else if (is_end(a_match_set) && !is_end(b_match_set))
+	{
+		match_set_map_.emplace(a, match_set_at(b_match_set));
+		match_set_at(b_match_set)->push_back(a);
+	}
+	else // a_it != end && b_it != end
+	{
+		if (match_set_at(a_match_set) != match_set_at(b_match_set))
 		{
-			if (match_set_at(a_match_set) != match_set_at(b_match_set))
+			/*
+			 * coalesce b's match set into a's match set; every member of
+			 * b's set has to be moved, not just b
+			 */
+			match_set_ptr a_set = match_set_at(a_match_set);
+			match_set_ptr b_set = match_set_at(b_match_set);
+			for (auto member : *b_set)
 			{
-				// coalesce b's match set into a's match set
-//				std::cout << *(path_at(a_match_set)) << " matched " 
-//						<< *(path_at(b_match_set)) 
-//						<< ", but they belong to disjoint match sets; coalescing" 
-//						<< std::endl;
-				for (auto b_match_set_member = match_set_at(b_match_set)->begin(); 
-					 b_match_set_member != match_set_at(b_match_set)->end(); 
-					 ++ b_match_set_member)
-				{
-					match_set_at(a_match_set)->insert(*b_match_set_member);
-				}
-				match_sets_.erase(match_set_at(b_match_set));
-				match_set_at(b_match_set) = match_set_at(a_match_set);
-			} // else nothing -- both are already in the same match set
+				a_set->push_back(member);
+				match_set_map_[member] = a_set;
+			}
+			match_sets_.erase(b_set);
+		} // else nothing -- both are already in the same match set
+	}
+}
+
+void image_matcher::merge_duplicates(bool report)
+{
+	if (duplicates_.empty())
+	{
+		return;
+	}
+
+	/*
+	 * Byte-identical copies never entered the comparisons; they go wherever
+	 * their originals went. With a target, a copy is only reported if its 
+	 * original matched something, since images within the target (or within
+	 * the search directories) aren't compared with each other.
+	 */
+
+	for (auto const& dup : duplicates_)
+	{
+		if (!store_.has_hist(dup.original))
+		{
+			continue;
+		}
+		if (use_target_ && match_set_map_.count(dup.original) == 0)
+		{
+			continue;
+		}
+		store_.copy(dup.id, dup.original);
+		if (report && results_.is_open())
+		{
+			results_.write_match(path_of(dup.original), path_of(dup.id), 0.0);
+		}
+		add_match(dup.original, dup.id, 0.0);
+	}
+
+	if (report && verbose_ > 0)
+	{
+		std::cout << duplicates_.size() 
+				<< " byte-identical copies were not decoded" << std::endl;
+	}
+}
+
+void image_matcher::generate_results()
+{
+	if (thresholds_.empty())
+	{
+		merge_duplicates(true);
+		generate_symlinks();
+		return;
+	}
+
+	/*
+	 * The join was done at the loosest threshold, keeping every matching
+	 * pair, so the match sets for each tighter threshold are just the 
+	 * components of the pairs within it. Each threshold gets its own 
+	 * subdirectory of the results directory.
+	 */
+	if (!fs::exists(results_path_))
+	{
+		if (!create_dir(results_path_)) return;
+	}
+
+	fs::path results_root(results_path_);
+	double loosest = match_threshold_;
+	bool first = true;
+
+	for (auto const& threshold : thresholds_)
+	{
+		match_threshold_ = threshold.value;
+		match_set_map_.clear();
+		match_sets_.clear();
+		std::fill(match_sums_.begin(), match_sums_.end(), match_sums{0.0, 0});
+		for (auto const& edge : edges_)
+		{
+			if (edge.distance <= match_threshold_)
+			{
+				add_match(edge.a, edge.b, edge.distance);
+			}
+		}
+		merge_duplicates(first);
+		first = false;
+
+		results_path_ = results_root / ("t" + threshold.name);
+		if (results_.is_open())
+		{
+			results_.set_threshold(threshold.value);
 		}
+		std::cout << "threshold " << threshold.name << ": ";
+		generate_symlinks();
 	}
+
+	results_path_ = results_root;
+	match_threshold_ = loosest;
 }
 
-void image_matcher::generate_symlinks(path_hist_map const& hist_map) const
+void image_matcher::generate_symlinks()
 {
 	if (match_sets_.size() > 0)
 	{
@@ -767,6 +2956,9 @@ void image_matcher::generate_symlinks(path_hist_map const& hist_map) const
 			return;
 		}
 		
+		link_writer links;
+		if (!links.open(results_path_)) return;
+
 		std::size_t match_set_count = 0ul;
 		
 		for (auto match_set_it = match_sets_.begin(); 
@@ -774,98 +2966,410 @@ void image_matcher::generate_symlinks(path_hist_map const& hist_map) const
 			 ++match_set_it)
 		{
 			match_set_ptr match_set = *match_set_it;
-			std::vector<path_ptr> path_vec;
-			for (auto pit = match_set->begin(); pit != match_set->end(); ++pit)
-			{
-				path_vec.push_back(*pit);
-			}
-			std::size_t n = match_set->size();
-			std::vector<std::vector<double>> dist_matrix;
-			dist_matrix.reserve(n);
+			std::vector<image_id> id_vec(match_set->begin(), match_set->end());
+			std::sort(id_vec.begin(), id_vec.end(),
+					  [this](image_id a, image_id b)
+					  {
+						  return paths_.less(a, b);
+					  });
+			std::size_t n = id_vec.size();
 
+			/*
+			 * Only the recorded matches have distances. Pairs without one 
+			 * were either compared and found further apart than the 
+			 * threshold, or never compared (two search images with a target,
+			 * or a byte-identical copy, which only has an edge to its 
+			 * original), so counting each of them at the threshold only 
+			 * approximates an image's sum of squared distances to the rest 
+			 * of the set. The image with the smallest estimate is taken as 
+			 * the medoid.
+			 */
+			double unmatched_sq = match_threshold_ * match_threshold_;
+			auto min_index = 0u;
+			auto min_value = std::numeric_limits<double>::infinity();
 			for (auto i = 0u; i < n; ++i)
 			{
-				dist_matrix.emplace_back(n, 0.0);
-			}
-
-			for (auto i = 0u; i < n - 1; ++i)
-			{
-				for (auto j = i + 1; j < n; ++j)
+				match_sums const& sums = match_sums_[id_vec[i]];
+				double value = sums.sum_sq 
+						+ (static_cast<double> (n - 1) - sums.count) * unmatched_sq;
+				if (value < min_value)
 				{
-					auto i_hist = hist_map.find(path_vec[i]);
-					if (i_hist == hist_map.end())
-					{
-						std::cerr << "error: histogram for " 
-								<< *(path_vec[i]) << " not found in map" 
-								<< std::endl;
-						return;
-					}
-
-					auto j_hist = hist_map.find(path_vec[j]);
-					if (j_hist == hist_map.end())
-					{
-						std::cerr << "error: histogram for " 
-								<< *(path_vec[j]) << " not found in map" 
-								<< std::endl;
-						return;
-					}
-					auto dist = 
-						histogram_at(i_hist).chi_sqr_dist(histogram_at(j_hist));
-					dist_matrix[i][j] = dist;
-					dist_matrix[j][i] = dist;					
+					min_value = value;
+					min_index = i;
 				}
 			}
-			
-			std::vector<double> sum_sq_err;
-			sum_sq_err.reserve(n);
+
+			std::vector<double> distances;
+			distances.reserve(n);
 			for (auto i = 0u; i < n; ++i)
 			{
-				double sum = 0.0;
-				for (auto j = 0u; j < n; ++j)
-				{
-					double d = dist_matrix[i][j];
-					sum += d * d;
-				}
-				sum_sq_err.push_back(sum);
+				distances.push_back(i == min_index ? 0.0 
+						: store_.chi_sqr_dist(id_vec[min_index], id_vec[i]));
 			}
-			
-			auto min_index = 0u;
-			auto min_value = sum_sq_err[min_index];
-			for (auto i = 1u; i < n; ++i)
+
+			if (results_.is_open())
 			{
-				if (sum_sq_err[i] < min_value)
+				std::vector<fs::path> members;
+				members.reserve(n);
+				for (auto id : id_vec)
 				{
-					min_value = sum_sq_err[i];
-					min_index = i;
+					members.push_back(path_of(id));
 				}
+				results_.write_cluster(match_set_count, members, distances, 
+									   min_index);
 			}
 
-			create_matching_links(path_vec,
-								 dist_matrix[min_index],
-								 match_set_count++);
+			add_matching_links(links,
+							   id_vec,
+							   distances,
+							   match_set_count++);
 			
 		}
+		links.write();
 		
 		std::cout << match_set_count << " match sets were found, containing " 
 				<< match_set_map_.size() << " matching files" 
 				<< std::endl;
+		if (results_.is_open())
+		{
+			results_.write_summary(match_set_count, match_set_map_.size());
+		}
 	}
 	else
 	{
 		std::cout << "no matches found" << std::endl;
+		if (results_.is_open())
+		{
+			results_.write_summary(0, 0);
+		}
 	}
 }
 
 void 
-image_matcher::build_histogram(path_ptr p, path_hist_map& hmap)
+image_matcher::build_histogram(image_id id, 
+							   image_set& images,
+							   std::vector<unsigned char> const* contents)
+{
+	fs::path p = path_of(id);
+	content_key key{0, 0};
+	content_entry entry{id, scope_, 0, false};
+	std::uint64_t file_size = 0;
+	std::time_t mtime = 0;
+
+	if (uses_catalog())
+	{
+		boost::system::error_code ec;
+		file_size = fs::file_size(p, ec);
+		mtime = fs::last_write_time(p, ec);
+		if (!ec && catalog_.fetch(p, file_size, mtime, store_, id))
+		{
+			if (store_.has_screen())
+			{
+				store_.set_screen(id);
+			}
+			images.push_back(id);
+			catalog_.add(id, file_size, mtime);
+			return;
+		}
+	}
+
+	bool hashed = hash_duplicates_ 
+			&& hash_file_prefix(p.string(), key.size, key.prefix_hash);
+
+	if (hashed && find_identical(id, key, entry, images))
+	{
+		return;
+	}
+
+	bitmap_image img;
+	std::vector<unsigned char> file_contents;
+
+	/*
+	 * with a read order, the file is read whole before it's decoded, so 
+	 * the time spent on I/O can be told apart from decoding
+	 */
+	if (!contents && read_order_ != file_order::listed)
+	{
+		auto start = std::chrono::steady_clock::now();
+		int error = file_reader::read(p.string(), file_contents);
+		io_seconds_ += std::chrono::duration<double> (
+				std::chrono::steady_clock::now() - start).count();
+		if (error == 0)
+		{
+			contents = &file_contents;
+		}
+	}
+	++files_read_;
+	if (contents)
+	{
+		bytes_read_ += contents->size();
+	}
+	else
+	{
+		boost::system::error_code ec;
+		std::uint64_t file_size = fs::file_size(p, ec);
+		bytes_read_ += ec ? 0 : file_size;
+	}
+
+	if (read_image_file(p, img, contents))
+	{
+		store_.set(id, image_hist(store_.geometry(), img));
+		if (store_.has_screen())
+		{
+			store_.set_screen(id, image_hist(store_.screen_geometry(), img));
+		}
+		if (!store_.has_hist(id))
+		{
+			return;
+		}
+		images.push_back(id);
+		if (hashed)
+		{
+			content_index_[key].push_back(entry);
+		}
+		if (uses_catalog())
+		{
+			catalog_.add(id, file_size, mtime);
+		}
+	}			
+}
+
+bool
+image_matcher::probe_image_file(fs::path const& image_path, image_info& info) const
+{
+	std::string suffix = this->filename_suffix(image_path);
+	if (is_jpeg_suffix(suffix))
+	{
+		return probe_jpeg_file(image_path.string(), info);
+	}
+	else if (is_png_suffix(suffix))
+	{
+		return probe_png_file(image_path.string(), info);
+	}
+	else if (is_bmp_suffix(suffix))
+	{
+		return probe_bmp_file(image_path.string(), info);
+	}
+	return false;
+}
+
+bool
+image_matcher::passes_probe(image_id id)
+{
+	if (!uses_probe())
+	{
+		return true;
+	}
+
+	/* files whose headers can't be read are left for the decoder to report */
+	fs::path p = path_of(id);
+	image_info info;
+	if (!probe_image_file(p, info))
+	{
+		return true;
+	}
+	++probed_;
+	if (verbose_ > 1)
+	{
+		std::cout << p.filename() << ": " << info.width << "x" << info.height 
+				<< " " << info.format << ", " << info.color << ", " 
+				<< info.bits_per_pixel << " bits per pixel" << std::endl;
+	}
+
+	double megapixels = static_cast<double> (info.width) * info.height / 1.0e6;
+	bool passes = (min_megapixels_ <= 0.0 || megapixels >= min_megapixels_)
+			&& (max_megapixels_ <= 0.0 || megapixels <= max_megapixels_);
+	if (passes && target_aspect_ > 0.0)
+	{
+		/* matches may be rotated, so orientation doesn't count */
+		unsigned long_side = std::max(info.width, info.height);
+		unsigned short_side = std::min(info.width, info.height);
+		passes = short_side > 0 
+				&& std::abs(static_cast<double> (long_side) / short_side 
+							/ target_aspect_ - 1.0) <= aspect_tolerance_;
+	}
+	if (!passes)
+	{
+		++probe_rejected_;
+		if (verbose_ > 1)
+		{
+			std::cout << "rejected " << p.filename() << " without decoding" 
+					<< std::endl;
+		}
+	}
+	return passes;
+}
+
+bool
+image_matcher::find_alias(image_id id)
+{
+	struct stat st;
+	if (::stat(path_of(id).c_str(), &st) != 0)
+	{
+		return false;
+	}
+	file_identity identity{static_cast<std::uint64_t> (st.st_dev), 
+						   static_cast<std::uint64_t> (st.st_ino)};
+	auto found = identities_.emplace(identity, id);
+	if (found.second || found.first->second == id)
+	{
+		return false;
+	}
+
+	image_id original = found.first->second;
+	if (watching_)
+	{
+		/*
+		 * the first path may have been deleted since, and its inode reused
+		 * by a new file
+		 */
+		struct stat original_st;
+		if (::stat(path_of(original).c_str(), &original_st) != 0
+			|| original_st.st_dev != st.st_dev 
+			|| original_st.st_ino != st.st_ino)
+		{
+			found.first->second = id;
+			return false;
+		}
+	}
+
+	if (verbose_ > 1)
+	{
+		std::cout << path_of(id).filename() << " is the same file as " 
+				<< path_of(original) << ", not decoding" << std::endl;
+	}
+	aliases_.push_back(duplicate{id, original});
+	return true;
+}
+
+void
+image_matcher::forget_file(image_id id)
+{
+	/* the file may have a new inode, and surely has new contents */
+	for (auto it = identities_.begin(); it != identities_.end();)
+	{
+		it = it->second == id ? identities_.erase(it) : std::next(it);
+	}
+	for (auto& entry : content_index_)
+	{
+		auto& entries = entry.second;
+		entries.erase(std::remove_if(entries.begin(), entries.end(),
+									 [id](content_entry const& e)
+									 {
+										 return e.id == id;
+									 }),
+					  entries.end());
+	}
+}
+
+void
+image_matcher::report_aliases()
+{
+	if (aliases_.empty())
+	{
+		return;
+	}
+
+	std::vector<duplicate> aliases(aliases_);
+	std::sort(aliases.begin(), aliases.end(), 
+			  [this](duplicate const& a, duplicate const& b)
+			  {
+				  return a.original != b.original 
+						  ? paths_.less(a.original, b.original)
+						  : paths_.less(a.id, b.id);
+			  });
+
+	std::size_t group_count = 0;
+	for (auto first = aliases.begin(); first != aliases.end();)
+	{
+		auto last = first;
+		std::vector<fs::path> paths;
+		while (last != aliases.end() && last->original == first->original)
+		{
+			paths.push_back(path_of(last->id));
+			++last;
+		}
+		if (results_.is_open())
+		{
+			results_.write_aliases(path_of(first->original), paths);
+		}
+		if (verbose_ > 0)
+		{
+			std::cout << "aliases of " << path_of(first->original) << ":" 
+					<< std::endl;
+			for (auto const& p : paths)
+			{
+				std::cout << "    " << p << std::endl;
+			}
+		}
+		++group_count;
+		first = last;
+	}
+
+	std::cout << aliases_.size() 
+			<< (aliases_.size() == 1 ? " path leads" : " paths lead") 
+			<< " to " << group_count 
+			<< (group_count == 1 ? " file" : " files")
+			<< " already found, through hard links or bind mounts; "
+			<< "they were not decoded or matched" << std::endl;
+}
+
+bool
+image_matcher::find_identical(image_id id, content_key const& key, 
+							  content_entry& entry, image_set& images)
 {
-	if (hmap.count(p) == 0)
+	auto found = content_index_.find(key);
+	if (found == content_index_.end())
+	{
+		return false;
+	}
+
+	if (!hash_file(path_of(id).string(), entry.full_hash))
+	{
+		return false;
+	}
+	entry.has_full_hash = true;
+
+	for (auto& candidate : found->second)
 	{
-		bitmap_image img;
+		if (candidate.id == id)
+		{
+			continue;
+		}
+		if (!candidate.has_full_hash)
+		{
+			if (!hash_file(path_of(candidate.id).string(), candidate.full_hash))
+			{
+				continue;
+			}
+			candidate.has_full_hash = true;
+		}
+		if (candidate.full_hash != entry.full_hash)
+		{
+			continue;
+		}
+
+		if (verbose_ > 1)
+		{
+			std::cout << path_of(id).filename() << " is identical to " 
+					<< path_of(candidate.id) << ", not decoding" << std::endl;
+		}
 
-		if (read_image_file(*p, img))
+		if (candidate.scope == scope_)
 		{
-			hmap.emplace(p,img);
-		}			
+			duplicates_.push_back(duplicate{id, candidate.id});
+		}
+		else
+		{
+			/*
+			 * The original belongs to a different set of images (e.g., it's
+			 * in the target, and this copy is in a search directory), so the
+			 * copy must still be compared; just reuse the histogram.
+			 */
+			store_.copy(id, candidate.id);
+			images.push_back(id);
+		}
+		return true;
 	}
+	return false;
 }
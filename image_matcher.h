@@ -30,11 +30,27 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
+#include <queue>
 #include <algorithm>
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/path.hpp"
+#include "boost/filesystem/directory.hpp"
 #include <boost/functional/hash.hpp>
 #include "image_hist.h"
+#include "image_info.h"
+#include "hist_store.h"
+#include "hist_pca.h"
+#include "path_table.h"
+#include "result_writer.h"
+#include "link_writer.h"
+#include "dir_walker.h"
+#include "dir_watcher.h"
+#include "edge_file.h"
+#include "file_list.h"
+#include "file_order.h"
+#include "file_reader.h"
+#include "image_catalog.h"
+#include "pair_cache.h"
 
 namespace fs = boost::filesystem;
 
@@ -61,6 +77,31 @@ public:
 		return 1000;
 	}
 
+	static constexpr double
+	default_bucket_limit()
+	{
+		return 0.02;
+	}
+
+	static std::string const&
+	default_bucket_limit_display()
+	{
+		static const std::string str("0.02");
+		return str;
+	}
+
+	static constexpr double
+	default_pca_tolerance()
+	{
+		return 1.0;
+	}
+
+	static constexpr int
+	default_read_depth()
+	{
+		return 32;
+	}
+
 	/*
 	 *	Initial values will all be set from command-line options.
 	 */
@@ -76,7 +117,52 @@ public:
 	target_is_dir_{false},
 	search_paths_{},
 	annotate_links_{false},
-	exhaustive_{false}
+	exhaustive_{false},
+	pca_dims_{0},
+	pca_basis_path_{},
+	pca_tolerance_{default_pca_tolerance()},
+	pca_{},
+	pca_screened_{0},
+	comparisons_{0},
+	hash_duplicates_{false},
+	bucket_limit_{0.0},
+	store_{},
+	hist_screened_{0},
+	top_k_{0},
+	results_{},
+	thresholds_{},
+	edges_{},
+	pair_cache_path_{},
+	pair_cache_{},
+	cached_pairs_{0},
+	catalog_path_{},
+	catalog_{},
+	watch_{false},
+	watching_{false},
+	scope_{0},
+	shard_{0},
+	shard_count_{0},
+	merge_paths_{},
+	max_memory_{0},
+	released_rows_{0},
+	files_from_{},
+	recursive_{false},
+	read_mode_{read_mode::file},
+	drop_cache_{false},
+	read_order_{file_order::listed},
+	files_read_{0},
+	bytes_read_{0},
+	build_seconds_{0.0},
+	io_seconds_{0.0},
+	min_megapixels_{0.0},
+	max_megapixels_{0.0},
+	aspect_tolerance_{-1.0},
+	target_aspect_{0.0},
+	probed_{0},
+	probe_rejected_{0},
+	read_depth_{default_read_depth()},
+	reader_{},
+	queued_{}
 	{
 	}
 
@@ -96,6 +182,65 @@ public:
 
 	void set_limit(int limit);
 
+	void set_pca_dims(int dims);
+
+	void set_pca_basis_path(std::string const& basis_path_string);
+
+	void set_pca_tolerance(double tolerance);
+
+	void set_hash_duplicates(bool value);
+
+	void set_bucket_limit(double bucket_limit);
+
+	bool set_geometry(std::string const& geometry_name);
+
+	bool set_screen_geometry(std::string const& geometry_name);
+
+	void set_top_k(int top_k);
+
+	bool set_output_format(std::string const& format_name);
+
+	bool set_thresholds(std::string const& thresholds_string);
+
+	void set_pair_cache_path(std::string const& cache_path_string);
+
+	void set_catalog_path(std::string const& catalog_path_string);
+
+	void set_watch(bool value);
+
+	bool set_shard(std::string const& shard_string);
+
+	bool set_merge_paths(string_vec const& merge_path_strings);
+
+	bool set_max_memory(std::string const& max_memory_string);
+
+	/*
+	 * Searches the files named in a list (a file, or "-" for standard 
+	 * input) as well as those in the search directories.
+	 */
+	bool set_files_from(std::string const& list_string);
+
+	void set_recursive(bool value);
+
+	bool set_read_method(std::string const& method_name);
+
+	void set_read_depth(int depth);
+
+	void set_drop_cache(bool value);
+
+	bool set_read_order(std::string const& order_name);
+
+	void set_min_megapixels(double megapixels);
+
+	void set_max_megapixels(double megapixels);
+
+	/*
+	 * With a target file, images whose aspect ratio (long side over short
+	 * side) differs from the target's by more than this fraction aren't
+	 * decoded.
+	 */
+	void set_aspect_tolerance(double tolerance);
+
 	bool set_results_path(std::string const& results_path_string);
 
 	void show_options() const;
@@ -154,63 +299,190 @@ public:
 		return exhaustive_;
 	}
 
+	inline bool
+	use_buckets() const
+	{
+		return match_threshold_ <= bucket_limit_;
+	}
+
+	inline bool
+	use_pca() const
+	{
+		return pca_dims_ > 0 || !pca_basis_path_.empty();
+	}
+
 	void execute();
 
 private:
 	
-	using path_ptr = std::shared_ptr<fs::path>;
-	using path_ptr_vec = std::vector<path_ptr>;
-	
-	struct path_ptr_equals
+	/*
+	 * The ids of the images in one group of images that are compared with
+	 * each other (or with another group), e.g., the target images or the 
+	 * images in one search directory.
+	 */
+	using image_set = std::vector<image_id>;
+
+	using match_set = std::vector<image_id>;
+	using match_set_ptr = std::shared_ptr<match_set>;
+	using match_set_map = std::unordered_map<image_id, match_set_ptr>;
+	using match_set_set = std::unordered_set<match_set_ptr>;
+
+	/*
+	 * Files are first grouped by size and a hash of their first few 
+	 * kilobytes; the full contents are only hashed when that collides.
+	 */
+	struct content_key
 	{
-		bool operator()(path_ptr const& a, path_ptr const& b) const
+		std::uint64_t size;
+		std::uint64_t prefix_hash;
+
+		bool operator==(content_key const& other) const
 		{
-			return *a == *b;
+			return size == other.size && prefix_hash == other.prefix_hash;
 		}
 	};
-	
-	struct path_ptr_hash
+
+	struct content_key_hash
 	{
-		std::size_t operator()(path_ptr const& p) const
+		std::size_t operator()(content_key const& key) const
 		{
-			return boost::filesystem::hash_value(*p);
+			std::size_t seed = 0;
+			boost::hash_combine(seed, key.size);
+			boost::hash_combine(seed, key.prefix_hash);
+			return seed;
 		}
 	};
-	
-	struct path_ptr_less
+
+	/*
+	 * Paths with the same device and inode number are the same file, 
+	 * reached through hard links or bind mounts.
+	 */
+	struct file_identity
 	{
-		bool operator()(path_ptr const& a, path_ptr const& b) const
+		std::uint64_t dev;
+		std::uint64_t ino;
+
+		bool operator==(file_identity const& other) const
 		{
-			return a->compare(*b) < 0;
+			return dev == other.dev && ino == other.ino;
 		}
 	};
-	
-	using path_set = std::unordered_set<path_ptr, path_ptr_hash, path_ptr_equals>;
-	using path_hist_map = std::unordered_map<path_ptr, rgb_image_hist>;
-	using match_set = std::set<path_ptr, path_ptr_less>;
-	using match_set_ptr = std::shared_ptr<match_set>;
-	using match_set_map = std::unordered_map<path_ptr, match_set_ptr>;
-	using match_set_set = std::unordered_set<match_set_ptr>;
 
+	struct file_identity_hash
+	{
+		std::size_t operator()(file_identity const& identity) const
+		{
+			std::size_t seed = 0;
+			boost::hash_combine(seed, identity.dev);
+			boost::hash_combine(seed, identity.ino);
+			return seed;
+		}
+	};
 
-	inline rgb_image_hist const& histogram_at(path_hist_map::const_iterator it) const
+	struct content_entry
 	{
-		return it->second;
-	}
-	
-	inline match_set_ptr match_set_at(match_set_map::iterator it) const
+		image_id id;
+		std::size_t scope;
+		std::uint64_t full_hash;
+		bool has_full_hash;
+	};
+
+	struct duplicate
 	{
-		return it->second;
-	}
-	
-	inline path_ptr path_at(match_set_map::const_iterator it) const
+		image_id id;
+		image_id original;
+	};
+
+	/*
+	 * How image files are read: each as it's decoded; the same, but 
+	 * with the kernel told which files are coming; or ahead of decoding,
+	 * by a file_reader.
+	 */
+	enum class read_mode
+	{
+		file,
+		prefetch,
+		pread,
+		uring
+	};
+
+	/*
+	 * An image whose histogram will be built once the files queued ahead
+	 * of it have been; read is true if its contents come from the reader.
+	 */
+	struct queued_image
+	{
+		image_id id;
+		image_set* images;
+		bool read;
+	};
+
+	/*
+	 * An entry in a ranked list of nearest matches. Entries are ordered by
+	 * distance, then by id, so that a max-heap of entries has the worst 
+	 * match on top.
+	 */
+	struct ranked_match
+	{
+		double distance;
+		image_id id;
+
+		bool operator<(ranked_match const& other) const
+		{
+			if (distance != other.distance)
+			{
+				return distance < other.distance;
+			}
+			return id < other.id;
+		}
+	};
+
+	/*
+	 * Running totals of the distances between an image and the images it
+	 * matched, as they were calculated, so that match sets' medoids can be 
+	 * chosen without comparing every pair in each set again.
+	 */
+	struct match_sums
+	{
+		double sum_sq;
+		std::uint32_t count;
+	};
+
+	/*
+	 * A matching pair, kept when sweeping several thresholds, so that the
+	 * match sets for each threshold can be found without comparing again.
+	 */
+	struct match_edge
+	{
+		image_id a;
+		image_id b;
+		double distance;
+	};
+
+	struct sweep_threshold
 	{
-		return it->first;
+		double value;
+		std::string name;
+	};
+
+	using ranked_list = std::vector<ranked_match>;
+	using ranked_heap = std::priority_queue<ranked_match>;
+
+	using content_index = 
+			std::unordered_map<content_key, std::vector<content_entry>, content_key_hash>;
+
+	using identity_index = 
+			std::unordered_map<file_identity, image_id, file_identity_hash>;
+
+
+	inline fs::path path_of(image_id id) const
+	{
+		return paths_.path(id);
 	}
-	
-	inline path_ptr path_at(path_hist_map::const_iterator it) const
+
+	inline match_set_ptr match_set_at(match_set_map::iterator it) const
 	{
-		return it->first;
+		return it->second;
 	}
 	
 	inline bool is_end(match_set_map::iterator it) 
@@ -276,24 +548,77 @@ private:
 						 suffix) != bmp_suffixes.end();
 	}
 	
-	bool read_image_file(fs::path const& fpath, bitmap_image& image) const;
+	/*
+	 * Decodes contents, if given, rather than reading the file.
+	 */
+	bool read_image_file(fs::path const& fpath, 
+						 bitmap_image& image,
+						 std::vector<unsigned char> const* contents = nullptr) const;
+
+	void compare(image_id a, image_id b);
+
+	void record_distance(image_id a, image_id b, double distance);
+
+	/*
+	 * Every few thousand comparisons, lets streamed results that have
+	 * waited too long reach the output, even if no more matches follow.
+	 */
+	inline void
+	poll_results()
+	{
+		if ((comparisons_ & 0xfff) == 0)
+		{
+			results_.poll();
+		}
+	}
+
+	/*
+	 * Reports a match, whether it was just found or replayed from the pair
+	 * cache.
+	 */
+	void report_match(image_id a, image_id b, double distance);
+
+	void add_match(image_id a, image_id b, double distance);
+
+	bool find_alias(image_id id);
+
+	/*
+	 * Drops what's known about a file's identity and contents, when it's
+	 * rewritten.
+	 */
+	void forget_file(image_id id);
+
+	bool probe_image_file(fs::path const& fpath, image_info& info) const;
+
+	inline bool
+	uses_probe() const
+	{
+		return min_megapixels_ > 0.0 || max_megapixels_ > 0.0 || target_aspect_ > 0.0;
+	}
+
+	bool passes_probe(image_id id);
 
-	void compare(path_hist_map::const_iterator a, path_hist_map::const_iterator b);
+	void report_aliases();
+
+	bool find_identical(image_id id, content_key const& key, 
+						content_entry& entry, image_set& images);
+
+	void merge_duplicates(bool report);
+
+	void generate_results();
 	
-	void generate_symlinks(path_hist_map const& hist_map) const;	
+	void generate_symlinks();	
 	
 	bool create_dir(fs::path const& dir_path) const;
 
-	bool create_symlink(fs::path const& link_target,
-						std::string const& link_name,
-						fs::path const& link_dir) const;
-
 	fs::path find_available_name(fs::path const& results_parent,
 								 fs::path const& dir_filename) const;
 
-	void create_matching_links(std::vector<path_ptr> const& paths, 
-							   std::vector<double> const& distances, 
-							   std::size_t set_index) const;
+	void add_matching_links(link_writer& links,
+							std::vector<image_id> const& ids, 
+							std::vector<double> const& distances, 
+							std::size_t set_index,
+							bool ranked = false) const;
 
 	static const std::vector<std::string> jpeg_suffixes;
 
@@ -301,13 +626,104 @@ private:
 
 	static const std::vector<std::string> bmp_suffixes;
 
-	void build_histograms(fs::path const& dir, path_hist_map& hmap);
+	bool add_path(fs::path const& p, image_id& id);
+
+	bool add_image_file(fs::path const& path, image_set& images);
+
+	void build_histograms(fs::path const& dir, image_set& images);
+
+	template <class Visit>
+	void for_each_listed_file(Visit visit);
+
+	void build_listed_histograms(image_set& images);
+
+	inline bool
+	has_file_list() const
+	{
+		return !files_from_.empty();
+	}
 	
-	void build_histogram(path_ptr p, path_hist_map& hmap);
+	void build_histogram(image_id id, 
+						 image_set& images,
+						 std::vector<unsigned char> const* contents = nullptr);
+
+	void queue_histogram(image_id id, image_set& images);
 
-	void find_matches(path_hist_map const& hmap);
+	void build_queued_histogram();
+
+	void build_queued_histograms();
+
+	void finish_histogram(image_id id);
+
+	void find_matches(image_set const& images);
 	
-	void find_matches(path_hist_map const& target_hmap, path_hist_map const& search_hmap);
+	void find_matches(image_set const& targets, image_set const& search);
+
+	void find_matches_cached(image_set const& images);
+
+	void find_matches_spilled(image_set const& images);
+
+	inline std::size_t
+	spill_block_rows() const
+	{
+		return std::max<std::size_t> (1, max_memory_ / (2 * store_.row_bytes()));
+	}
+
+	bool load_pair_cache();
+
+	void save_pair_cache() const;
+
+	void load_catalog();
+
+	void watch(std::vector<image_set>& scopes);
+
+	void watch_file(fs::path const& path, image_set& scope, image_set& batch);
+
+	void collect_image_files(fs::path const& dir, std::vector<fs::path>& files);
+
+	void walk_image_files(fs::path const& dir, std::vector<fs::path>& files) const;
+
+	void collect_listed_files(std::vector<fs::path>& files);
+
+	void match_shard();
+
+	void merge_shards();
+
+	inline bool
+	uses_catalog() const
+	{
+		return !catalog_path_.empty() && !use_target_;
+	}
+
+	using bucket_map = std::unordered_map<std::uint64_t, std::vector<std::size_t>>;
+
+	void bucket_keys(image_id id, 
+					 std::uint64_t& key, 
+					 std::vector<std::uint64_t>* probes) const;
+
+	void fill_buckets(image_set const& images, 
+					  image_set& items, 
+					  bucket_map& buckets) const;
+
+	void find_matches_by_bucket(image_set const& images);
+	
+	void find_matches_by_bucket(image_set const& targets, image_set const& search);
+
+	void find_matches_blocked(image_set const& targets, image_set const& search);
+
+	void find_nearest(image_set const& targets, image_set const& search);
+
+	void add_nearest_duplicates(ranked_list& list) const;
+
+	void generate_ranked_lists();
+
+	bool prepare_pca(std::vector<image_set const*> const& sets);
+
+	bool pca_screen(image_id a, image_id b) const;
+
+	void report_reading() const;
+
+	void report_screening() const;
 
 	double match_threshold_;
 	int limit_;
@@ -319,10 +735,67 @@ private:
 	std::vector<fs::path> search_paths_;
 	bool annotate_links_;
 	bool exhaustive_;
+	int pca_dims_;
+	fs::path pca_basis_path_;
+	double pca_tolerance_;
 	
-	path_set unique_paths_;
+	hist_pca pca_;
+	std::size_t pca_screened_;
+	std::size_t comparisons_;
+	bool hash_duplicates_;
+	content_index content_index_;
+	std::vector<duplicate> duplicates_;
+	identity_index identities_;
+	std::vector<duplicate> aliases_;
+	double bucket_limit_;
+	hist_store store_;
+	std::size_t hist_screened_;
+	std::size_t top_k_;
+	std::vector<std::pair<image_id, ranked_list>> ranked_lists_;
+	path_table paths_;
 	match_set_map match_set_map_;
 	match_set_set match_sets_;
+	std::vector<match_sums> match_sums_;
+	result_writer results_;
+	std::vector<sweep_threshold> thresholds_;
+	std::vector<match_edge> edges_;
+	fs::path pair_cache_path_;
+	pair_cache pair_cache_;
+	std::size_t cached_pairs_;
+	fs::path catalog_path_;
+	image_catalog catalog_;
+	bool watch_;
+	bool watching_;
+
+	/*
+	 * The set images being built belong to: 0 for the target, otherwise one
+	 * more than the set's slot among the search scopes. A byte-identical 
+	 * copy in the same set is a duplicate; in another, it's still compared.
+	 */
+	std::size_t scope_;
+	std::size_t shard_;
+	std::size_t shard_count_;
+	std::vector<fs::path> merge_paths_;
+	std::size_t max_memory_;
+	std::size_t released_rows_;
+	std::string files_from_;
+	bool recursive_;
+	read_mode read_mode_;
+	bool drop_cache_;
+	file_order read_order_;
+	std::size_t files_read_;
+	std::uint64_t bytes_read_;
+	double build_seconds_;
+	double io_seconds_;
+	double min_megapixels_;
+	double max_megapixels_;
+	double aspect_tolerance_;
+	double target_aspect_;
+	std::size_t probed_;
+	std::size_t probe_rejected_;
+	std::size_t read_depth_;
+	file_reader reader_;
+	std::deque<queued_image> queued_;
 
 };
 
@@ -0,0 +1,409 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "imgmatch.h"
+#include "image_index.h"
+
+struct imgmatch_index
+{
+	image_index index;
+};
+
+namespace
+{
+
+void
+to_c(image_index::histogram const& hist, imgmatch_histogram* out)
+{
+	out->bins = static_cast<uint32_t*> (std::malloc(hist.bins.size() * sizeof (uint32_t)));
+	out->bin_count = out->bins ? hist.bins.size() : 0;
+	if (out->bins)
+	{
+		std::memcpy(out->bins, hist.bins.data(), hist.bins.size() * sizeof (uint32_t));
+	}
+	out->pixel_count = hist.pixel_count;
+	out->fingerprint = hist.fingerprint;
+}
+
+image_index::histogram
+from_c(imgmatch_histogram const* hist)
+{
+	image_index::histogram result;
+	result.bins.assign(hist->bins, hist->bins + hist->bin_count);
+	result.pixel_count = hist->pixel_count;
+	result.fingerprint = hist->fingerprint;
+	return result;
+}
+
+inline imgmatch_neighbor
+to_c(image_index::neighbor const& n)
+{
+	return imgmatch_neighbor{n.id, n.distance};
+}
+
+inline imgmatch_match
+to_c(image_index::match const& m)
+{
+	return imgmatch_match{m.a, m.b, m.distance};
+}
+
+/*
+ * copies results into memory the caller frees with imgmatch_free
+ */
+template <class C, class T>
+std::size_t
+to_c_array(std::vector<T> const& items, C** results)
+{
+	*results = nullptr;
+	if (items.empty())
+	{
+		return 0;
+	}
+	*results = static_cast<C*> (std::malloc(items.size() * sizeof (C)));
+	if (!*results)
+	{
+		return 0;
+	}
+	for (auto i = 0ul; i < items.size(); ++i)
+	{
+		(*results)[i] = to_c(items[i]);
+	}
+	return items.size();
+}
+
+inline int
+status(bool ok)
+{
+	return ok ? 0 : -1;
+}
+
+} // namespace
+
+/*
+ * No exception may escape into C: every entry point that can throw (e.g.
+ * std::bad_alloc) catches it and returns its failure value.
+ */
+
+imgmatch_index*
+imgmatch_index_create(const char* bins)
+{
+	try
+	{
+		imgmatch_index* index = new imgmatch_index;
+		if (bins && !index->index.set_bins(bins))
+		{
+			delete index;
+			return nullptr;
+		}
+		return index;
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+void
+imgmatch_index_destroy(imgmatch_index* index)
+{
+	delete index;
+}
+
+int
+imgmatch_index_save(const imgmatch_index* index, const char* filename)
+{
+	try
+	{
+		return status(index->index.save(filename));
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+int
+imgmatch_index_load(imgmatch_index* index, const char* filename)
+{
+	try
+	{
+		return status(index->index.load(filename));
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+int
+imgmatch_index_add_file(imgmatch_index* index, const char* path, uint32_t* id)
+{
+	try
+	{
+		return status(index->index.add_file(path, *id));
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+int
+imgmatch_index_add_buffer(imgmatch_index* index, 
+						  const char* name, 
+						  const void* data, 
+						  size_t size, 
+						  uint32_t* id)
+{
+	try
+	{
+		return status(index->index.add_buffer(name, data, size, *id));
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+int
+imgmatch_index_add_histogram(imgmatch_index* index, 
+							 const char* name, 
+							 const imgmatch_histogram* hist, 
+							 uint32_t* id)
+{
+	try
+	{
+		return status(index->index.add_histogram(name, from_c(hist), *id));
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+size_t
+imgmatch_index_size(const imgmatch_index* index)
+{
+	return index->index.size();
+}
+
+const char*
+imgmatch_index_name(const imgmatch_index* index, uint32_t id)
+{
+	try
+	{
+		return index->index.name(id).c_str();
+	}
+	catch (...)
+	{
+		return nullptr;
+	}
+}
+
+int
+imgmatch_histogram_from_file(const imgmatch_index* index, 
+							 const char* path, 
+							 imgmatch_histogram* hist)
+{
+	try
+	{
+		image_index::histogram result;
+		if (!index->index.histogram_from_file(path, result))
+		{
+			return -1;
+		}
+		to_c(result, hist);
+		return status(hist->bins != nullptr);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+int
+imgmatch_histogram_from_buffer(const imgmatch_index* index, 
+							   const void* data, 
+							   size_t size, 
+							   imgmatch_histogram* hist)
+{
+	try
+	{
+		image_index::histogram result;
+		if (!index->index.histogram_from_buffer(data, size, result))
+		{
+			return -1;
+		}
+		to_c(result, hist);
+		return status(hist->bins != nullptr);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+}
+
+void
+imgmatch_histogram_free(imgmatch_histogram* hist)
+{
+	std::free(hist->bins);
+	hist->bins = nullptr;
+	hist->bin_count = 0;
+}
+
+double
+imgmatch_histogram_distance(const imgmatch_index* index,
+							const imgmatch_histogram* a, 
+							const imgmatch_histogram* b)
+{
+	try
+	{
+		return index->index.distance(from_c(a), from_c(b));
+	}
+	catch (...)
+	{
+		return -1.0;
+	}
+}
+
+double
+imgmatch_index_distance(const imgmatch_index* index, uint32_t a, uint32_t b)
+{
+	try
+	{
+		return index->index.distance(a, b);
+	}
+	catch (...)
+	{
+		return -1.0;
+	}
+}
+
+size_t
+imgmatch_index_query(const imgmatch_index* index, 
+					 const imgmatch_histogram* hist, 
+					 double threshold, 
+					 imgmatch_neighbor** results)
+{
+	*results = nullptr;
+	try
+	{
+		return to_c_array(index->index.query(from_c(hist), threshold), results);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+size_t
+imgmatch_index_nearest(const imgmatch_index* index, 
+					   const imgmatch_histogram* hist, 
+					   size_t k, 
+					   imgmatch_neighbor** results)
+{
+	*results = nullptr;
+	try
+	{
+		return to_c_array(index->index.nearest(from_c(hist), k), results);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+size_t
+imgmatch_index_matches(const imgmatch_index* index, 
+					   double threshold, 
+					   imgmatch_match** results)
+{
+	*results = nullptr;
+	try
+	{
+		return to_c_array(index->index.matches(threshold), results);
+	}
+	catch (...)
+	{
+		return 0;
+	}
+}
+
+size_t
+imgmatch_index_match_sets(const imgmatch_index* index, 
+						  double threshold, 
+						  uint32_t** ids, 
+						  size_t** offsets)
+{
+	*ids = nullptr;
+	*offsets = nullptr;
+	try
+	{
+		auto sets = index->index.match_sets(threshold);
+		if (sets.empty())
+		{
+			return 0;
+		}
+		std::size_t id_count = 0;
+		for (auto const& set : sets)
+		{
+			id_count += set.size();
+		}
+		*ids = static_cast<uint32_t*> (std::malloc(id_count * sizeof (uint32_t)));
+		*offsets = static_cast<size_t*> (std::malloc((sets.size() + 1) * sizeof (size_t)));
+		if (!*ids || !*offsets)
+		{
+			std::free(*ids);
+			std::free(*offsets);
+			*ids = nullptr;
+			*offsets = nullptr;
+			return 0;
+		}
+		std::size_t offset = 0;
+		for (auto s = 0ul; s < sets.size(); ++s)
+		{
+			(*offsets)[s] = offset;
+			std::copy(sets[s].begin(), sets[s].end(), *ids + offset);
+			offset += sets[s].size();
+		}
+		(*offsets)[sets.size()] = offset;
+		return sets.size();
+	}
+	catch (...)
+	{
+		std::free(*ids);
+		std::free(*offsets);
+		*ids = nullptr;
+		*offsets = nullptr;
+		return 0;
+	}
+}
+
+void
+imgmatch_free(void* results)
+{
+	std::free(results);
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+
+#ifndef IMGMATCH_H
+#define IMGMATCH_H
+
+/*
+ * The C interface of libimgmatch, for use from C and through FFI. It wraps
+ * image_index (see image_index.h); the functions behave the same way.
+ *
+ * Functions returning int return 0 on success and -1 on failure. Arrays
+ * and histograms returned by the library are freed with imgmatch_free and
+ * imgmatch_histogram_free. Running out of memory is a failure like any
+ * other, and the library prints nothing.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct imgmatch_index imgmatch_index;
+
+typedef struct imgmatch_histogram
+{
+	uint32_t* bins;
+	size_t bin_count;
+	uint64_t pixel_count;
+	uint64_t fingerprint;
+} imgmatch_histogram;
+
+typedef struct imgmatch_neighbor
+{
+	uint32_t id;
+	double distance;
+} imgmatch_neighbor;
+
+typedef struct imgmatch_match
+{
+	uint32_t a;
+	uint32_t b;
+	double distance;
+} imgmatch_match;
+
+/* bins is "8", "16", "32" or "565", or NULL for the default; returns NULL if it's invalid */
+imgmatch_index* imgmatch_index_create(const char* bins);
+
+void imgmatch_index_destroy(imgmatch_index* index);
+
+int imgmatch_index_save(const imgmatch_index* index, const char* filename);
+
+int imgmatch_index_load(imgmatch_index* index, const char* filename);
+
+int imgmatch_index_add_file(imgmatch_index* index, const char* path, uint32_t* id);
+
+int imgmatch_index_add_buffer(imgmatch_index* index, 
+							  const char* name, 
+							  const void* data, 
+							  size_t size, 
+							  uint32_t* id);
+
+int imgmatch_index_add_histogram(imgmatch_index* index, 
+								 const char* name, 
+								 const imgmatch_histogram* hist, 
+								 uint32_t* id);
+
+size_t imgmatch_index_size(const imgmatch_index* index);
+
+/* valid until the index is next changed */
+const char* imgmatch_index_name(const imgmatch_index* index, uint32_t id);
+
+int imgmatch_histogram_from_file(const imgmatch_index* index, 
+								 const char* path, 
+								 imgmatch_histogram* hist);
+
+int imgmatch_histogram_from_buffer(const imgmatch_index* index, 
+								   const void* data, 
+								   size_t size, 
+								   imgmatch_histogram* hist);
+
+void imgmatch_histogram_free(imgmatch_histogram* hist);
+
+/* negative if the histograms don't have the index's bins, or an id is out of range */
+double imgmatch_histogram_distance(const imgmatch_index* index,
+								   const imgmatch_histogram* a, 
+								   const imgmatch_histogram* b);
+
+double imgmatch_index_distance(const imgmatch_index* index, uint32_t a, uint32_t b);
+
+/* each of these returns the number of results, and sets *results to an array of them */
+size_t imgmatch_index_query(const imgmatch_index* index, 
+							const imgmatch_histogram* hist, 
+							double threshold, 
+							imgmatch_neighbor** results);
+
+size_t imgmatch_index_nearest(const imgmatch_index* index, 
+							  const imgmatch_histogram* hist, 
+							  size_t k, 
+							  imgmatch_neighbor** results);
+
+size_t imgmatch_index_matches(const imgmatch_index* index, 
+							  double threshold, 
+							  imgmatch_match** results);
+
+/*
+ * Returns the number of match sets at threshold (see image_index::match_sets).
+ * Sets *ids to the ids of their members, set after set, and *offsets to 
+ * where each set starts in *ids, with one more entry for the end; both are
+ * freed with imgmatch_free.
+ */
+size_t imgmatch_index_match_sets(const imgmatch_index* index, 
+								 double threshold, 
+								 uint32_t** ids, 
+								 size_t** offsets);
+
+void imgmatch_free(void* results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMGMATCH_H */
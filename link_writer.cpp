@@ -0,0 +1,174 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "link_writer.h"
+
+namespace
+{
+
+std::mutex error_mutex;
+
+void
+report_error(std::string const& what, fs::path const& where, int error)
+{
+	std::lock_guard<std::mutex> lock(error_mutex);
+	std::cerr << "error: " << what << " " << where 
+			<< ", error code message: " << std::strerror(error) << std::endl;
+}
+
+} // namespace
+
+link_writer::link_writer()
+:
+results_path_{},
+results_fd_{-1},
+dirs_{}
+{
+}
+
+link_writer::~link_writer()
+{
+	if (results_fd_ >= 0)
+	{
+		::close(results_fd_);
+	}
+}
+
+bool
+link_writer::open(fs::path const& results_path)
+{
+	results_path_ = results_path;
+	results_fd_ = ::open(results_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (results_fd_ < 0)
+	{
+		report_error("couldn't open results directory", results_path, errno);
+		return false;
+	}
+	return true;
+}
+
+std::size_t
+link_writer::add_dir(std::string const& name)
+{
+	dirs_.push_back(link_dir{name, {}, {}});
+	return dirs_.size() - 1;
+}
+
+void
+link_writer::add_link(std::size_t dir, 
+					  fs::path const& target, 
+					  std::string const& name)
+{
+	// link names must be unique
+	auto& names = dirs_[dir].names;
+	std::string link_name(name);
+	std::size_t dup_count = 0;
+	while (!names.insert(link_name).second)
+	{
+		link_name.assign("dup").append(std::to_string(dup_count++))
+				.append("_").append(name);
+	}
+	dirs_[dir].links.push_back(link{target.string(), link_name});
+}
+
+bool
+link_writer::write_dir(link_dir const& dir) const
+{
+	fs::path dir_path(results_path_);
+	dir_path /= dir.name;
+
+	if (::mkdirat(results_fd_, dir.name.c_str(), 0777) != 0)
+	{
+		report_error("couldn't create match set directory", dir_path, errno);
+		return false;
+	}
+	int dir_fd = ::openat(results_fd_, dir.name.c_str(), 
+						  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd < 0)
+	{
+		report_error("couldn't open match set directory", dir_path, errno);
+		return false;
+	}
+
+	bool result = true;
+	for (auto const& l : dir.links)
+	{
+		if (::symlinkat(l.target.c_str(), dir_fd, l.name.c_str()) != 0)
+		{
+			report_error("couldn't create symbolic link to " + l.target + " in", 
+						 dir_path, errno);
+			result = false;
+			break;
+		}
+	}
+	::close(dir_fd);
+	return result;
+}
+
+bool
+link_writer::write()
+{
+	if (results_fd_ < 0)
+	{
+		return false;
+	}
+
+	std::size_t thread_count = std::min<std::size_t>(
+			std::max(std::thread::hardware_concurrency(), 1u), dirs_.size());
+	std::atomic<std::size_t> next{0};
+	std::atomic<bool> result{true};
+
+	auto work = [&]()
+	{
+		for (auto i = next++; i < dirs_.size(); i = next++)
+		{
+			if (!write_dir(dirs_[i]))
+			{
+				result = false;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (auto i = 1ul; i < thread_count; ++i)
+	{
+		threads.emplace_back(work);
+	}
+	work();
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+
+	dirs_.clear();
+	return result;
+}
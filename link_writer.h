@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef LINK_WRITER_H
+#define LINK_WRITER_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <cstddef>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Creates match set directories full of symbolic links in a results 
+ * directory. Directories and links are added first, and link names that
+ * collide within a directory are made unique in memory, by prefixing 
+ * "dup0_", "dup1_", and so on, since a newly created directory only holds
+ * the links this writer puts there. Everything is then created by several
+ * threads at once, relative to open directory descriptors, so no path is
+ * looked up more than once and the filesystem is never probed for names.
+ */
+class link_writer
+{
+public:
+
+	link_writer();
+
+	~link_writer();
+
+	bool open(fs::path const& results_path);
+
+	std::size_t add_dir(std::string const& name);
+
+	void add_link(std::size_t dir, 
+				  fs::path const& target, 
+				  std::string const& name);
+
+	/*
+	 * Returns false if any directory or link couldn't be created; the
+	 * errors are reported as they happen.
+	 */
+	bool write();
+
+private:
+
+	struct link
+	{
+		std::string target;
+		std::string name;
+	};
+
+	struct link_dir
+	{
+		std::string name;
+		std::vector<link> links;
+		std::unordered_set<std::string> names;
+	};
+
+	bool write_dir(link_dir const& dir) const;
+
+	fs::path results_path_;
+	int results_fd_;
+	std::vector<link_dir> dirs_;
+};
+
+#endif /* LINK_WRITER_H */
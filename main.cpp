@@ -70,10 +70,112 @@ main(int argc, char** argv)
 		("exhaustive,x",
 			po::bool_switch()->default_value(false),
 			"exhaustive match in all search directories")
+
+		("recursive,R",
+			po::bool_switch()->default_value(false),
+			"search the subdirectories of search directories, too")
+
+		("top-k,k",
+			po::value<int>(),
+			"with a target, find the k nearest images to each target image")
+
+		("bins,b",
+			po::value<std::string>()->default_value("16"),
+			"set histogram bins { 8 | 16 | 32 | 565 }")
+
+		("screen-bins",
+			po::value<std::string>(),
+			"screen comparisons with coarser histograms { 8 | 16 | 32 }")
+
+		("bucket-limit",
+			po::value<double>()->
+			default_value(image_matcher::default_bucket_limit(),
+						  image_matcher::default_bucket_limit_display()),
+			"use fingerprint buckets when the match threshold is at most this")
+
+		("hash-dups",
+			po::bool_switch()->default_value(false),
+			"group byte-identical files by content hash without decoding")
 					
 		("limit,l", 
 			po::value<int>()->default_value(image_matcher::default_limit()),
-			 "set maximum images compared per search directory");
+			 "set maximum images compared per search directory")
+
+		("pca-dims",
+			po::value<int>(),
+			"screen comparisons with a pca projection of this many dimensions")
+
+		("pca-basis",
+			po::value<std::string>(),
+			"load pca basis from file, or train and save it there")
+
+		("pca-tolerance",
+			po::value<double>()->default_value(image_matcher::default_pca_tolerance()),
+			"scale match threshold for pca screening (< 1 trades recall for speed)")
+
+		("output",
+			po::value<std::string>(),
+			"stream results to stdout as they're found { jsonl | ndjson | csv }")
+
+		("thresholds",
+			po::value<std::string>(),
+			"comma-separated match thresholds to sweep in one pass, e.g. 0.02,0.05,0.1")
+
+		("pair-cache",
+			po::value<std::string>(),
+			"load compared pairs from file, and save them there")
+
+		("catalog",
+			po::value<std::string>(),
+			"load histograms and matches of unchanged images from file, and save them there")
+
+		("watch",
+			po::bool_switch()->default_value(false),
+			"keep matching new images as they land in the search directories")
+
+		("shard",
+			po::value<std::string>(),
+			"search only shard i of N (i/N) of all pairs, writing its matches to an edge file")
+
+		("merge",
+			po::bool_switch()->default_value(false),
+			"merge the edge files given as paths into match sets")
+
+		("max-memory",
+			po::value<std::string>(),
+			"keep histograms in at most this much memory, spilling the rest to disk (e.g. 512M, 4G)")
+
+		("reader",
+			po::value<std::string>(),
+			"read image files ahead of decoding { file | prefetch | pread | uring }")
+
+		("read-depth",
+			po::value<int>()->default_value(image_matcher::default_read_depth()),
+			"with --reader, the number of files read ahead at once")
+
+		("read-order",
+			po::value<std::string>(),
+			"order in which to read the files of each directory { listed | inode | physical }")
+
+		("min-megapixels",
+			po::value<double>(),
+			"skip images smaller than this, judging by their headers")
+
+		("max-megapixels",
+			po::value<double>(),
+			"skip images larger than this, judging by their headers")
+
+		("aspect-tolerance",
+			po::value<double>(),
+			"with a target file, skip images whose aspect ratio differs from the target's by more than this fraction")
+
+		("drop-cache",
+			po::bool_switch()->default_value(false),
+			"drop image files from the page cache once they've been read")
+
+		("files-from",
+			po::value<std::string>(),
+			"also search the files listed in this file, or - for stdin (newline- or NUL-separated)");
 	
 	po::options_description hidden("Hidden options");
 	hidden.add_options()
@@ -121,6 +223,14 @@ main(int argc, char** argv)
 
 	image_matcher matcher;
 
+	if (vm.count("output"))
+	{
+		if (!matcher.set_output_format(vm["output"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
 	if (vm.count("spew"))
 	{
 		matcher.set_verbose(vm["spew"].as<int>());
@@ -131,6 +241,14 @@ main(int argc, char** argv)
 		matcher.set_match_threshold(vm["match"].as<double>());
 	}
 
+	if (vm.count("thresholds"))
+	{
+		if (!matcher.set_thresholds(vm["thresholds"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
 	if (vm.count("target"))
 	{
 		if (!matcher.set_target(vm["target"].as<std::string>()))
@@ -139,20 +257,52 @@ main(int argc, char** argv)
 		}
 	}
 
-	if (vm.count("search"))
+	if (vm["merge"].as<bool>())
+	{
+		if (!matcher.set_merge_paths(vm.count("search") 
+				? vm["search"].as<string_vec> () : string_vec{}))
+		{
+			return 0;
+		}
+	}
+	else if (vm.count("search"))
 	{
 		matcher.set_search_paths(vm["search"].as<string_vec> ());
 	}
-	else
+	else if (!vm.count("files-from"))
 	{
 		matcher.set_search_paths({"."});
 	}
 
+	if (vm.count("files-from"))
+	{
+		if (!matcher.set_files_from(vm["files-from"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
 	if (vm.count("limit"))
 	{
 		matcher.set_limit(vm["limit"].as<int>());
 	}
 
+	if (vm.count("bins"))
+	{
+		if (!matcher.set_geometry(vm["bins"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
+	if (vm.count("screen-bins"))
+	{
+		if (!matcher.set_screen_geometry(vm["screen-bins"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
 	if (vm.count("results"))
 	{
 		if (!matcher.set_results_path(vm["results"].as<std::string>()))
@@ -162,6 +312,101 @@ main(int argc, char** argv)
 	}
 	
 	matcher.set_exhaustive(vm["exhaustive"].as<bool>());
+
+	matcher.set_recursive(vm["recursive"].as<bool>());
+
+	if (vm.count("reader"))
+	{
+		if (!matcher.set_read_method(vm["reader"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
+	if (vm.count("read-depth"))
+	{
+		matcher.set_read_depth(vm["read-depth"].as<int>());
+	}
+
+	matcher.set_drop_cache(vm["drop-cache"].as<bool>());
+
+	if (vm.count("min-megapixels"))
+	{
+		matcher.set_min_megapixels(vm["min-megapixels"].as<double>());
+	}
+
+	if (vm.count("max-megapixels"))
+	{
+		matcher.set_max_megapixels(vm["max-megapixels"].as<double>());
+	}
+
+	if (vm.count("aspect-tolerance"))
+	{
+		matcher.set_aspect_tolerance(vm["aspect-tolerance"].as<double>());
+	}
+
+	if (vm.count("read-order"))
+	{
+		if (!matcher.set_read_order(vm["read-order"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
+	matcher.set_hash_duplicates(vm["hash-dups"].as<bool>());
+
+	matcher.set_watch(vm["watch"].as<bool>());
+
+	if (vm.count("max-memory"))
+	{
+		if (!matcher.set_max_memory(vm["max-memory"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
+	if (vm.count("shard"))
+	{
+		if (!matcher.set_shard(vm["shard"].as<std::string>()))
+		{
+			return 0;
+		}
+	}
+
+	if (vm.count("bucket-limit"))
+	{
+		matcher.set_bucket_limit(vm["bucket-limit"].as<double>());
+	}
+
+	if (vm.count("top-k"))
+	{
+		matcher.set_top_k(vm["top-k"].as<int>());
+	}
+
+	if (vm.count("pca-dims"))
+	{
+		matcher.set_pca_dims(vm["pca-dims"].as<int>());
+	}
+
+	if (vm.count("pca-basis"))
+	{
+		matcher.set_pca_basis_path(vm["pca-basis"].as<std::string>());
+	}
+
+	if (vm.count("pca-tolerance"))
+	{
+		matcher.set_pca_tolerance(vm["pca-tolerance"].as<double>());
+	}
+
+	if (vm.count("pair-cache"))
+	{
+		matcher.set_pair_cache_path(vm["pair-cache"].as<std::string>());
+	}
+
+	if (vm.count("catalog"))
+	{
+		matcher.set_catalog_path(vm["catalog"].as<std::string>());
+	}
 	
 	assert(vm.count("annotate") > 0);
 	
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include "pair_cache.h"
+
+namespace
+{
+
+constexpr std::uint32_t cache_file_magic = 0x48435049; // "IPCH"
+constexpr std::uint32_t cache_file_version = 1;
+
+template <class T>
+inline void
+write_value(std::ostream& out, T const& value)
+{
+	out.write(reinterpret_cast<char const*> (&value), sizeof (value));
+}
+
+template <class T>
+inline bool
+read_value(std::istream& in, T& value)
+{
+	in.read(reinterpret_cast<char*> (&value), sizeof (value));
+	return static_cast<bool> (in);
+}
+
+} // namespace
+
+pair_cache::pair_cache()
+:
+thresholds_{},
+clique_of_{},
+edges_{},
+new_cliques_{},
+new_edges_{},
+new_pairs_{}
+{
+}
+
+bool
+pair_cache::load(std::string const& filename, hist_geometry geometry)
+{
+	std::ifstream in(filename, std::ios::binary);
+	if (!in)
+	{
+		return false;
+	}
+	return read(in, geometry);
+}
+
+bool
+pair_cache::read(std::istream& in, hist_geometry geometry)
+{
+	std::uint32_t magic = 0;
+	std::uint32_t version = 0;
+	std::uint32_t bin_count = 0;
+	std::uint64_t clique_count = 0;
+	if (!read_value(in, magic) || !read_value(in, version) 
+		|| !read_value(in, bin_count) || !read_value(in, clique_count)
+		|| magic != cache_file_magic || version != cache_file_version
+		|| bin_count != hist_geometry_bin_count(geometry))
+	{
+		return false;
+	}
+
+	std::vector<double> thresholds;
+	std::unordered_map<std::uint64_t, std::uint32_t> clique_of;
+	for (auto c = 0ul; c < clique_count; ++c)
+	{
+		double threshold = 0.0;
+		std::uint64_t size = 0;
+		if (!read_value(in, threshold) || !read_value(in, size))
+		{
+			return false;
+		}
+		thresholds.push_back(threshold);
+		for (auto i = 0ul; i < size; ++i)
+		{
+			std::uint64_t fingerprint = 0;
+			if (!read_value(in, fingerprint))
+			{
+				return false;
+			}
+			clique_of.emplace(fingerprint, static_cast<std::uint32_t> (c + 1));
+		}
+	}
+
+	std::uint64_t edge_count = 0;
+	if (!read_value(in, edge_count))
+	{
+		return false;
+	}
+	/* older runs could save a pair once for each directory it was in */
+	std::vector<edge> edges;
+	pair_set pairs;
+	for (auto i = 0ul; i < edge_count; ++i)
+	{
+		edge e;
+		if (!read_value(in, e.a) || !read_value(in, e.b) 
+			|| !read_value(in, e.distance))
+		{
+			return false;
+		}
+		if (pairs.insert(pair_key(e.a, e.b)).second)
+		{
+			edges.push_back(e);
+		}
+	}
+
+	thresholds_ = std::move(thresholds);
+	clique_of_ = std::move(clique_of);
+	edges_ = std::move(edges);
+	return true;
+}
+
+bool
+pair_cache::save(std::string const& filename, hist_geometry geometry) const
+{
+	/*
+	 * write a new file and move it into place, so a failed run can't leave
+	 * a truncated cache behind
+	 */
+	std::string temp_filename(filename);
+	temp_filename.append(".tmp");
+	{
+		std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+		if (!out || !write(out, geometry))
+		{
+			return false;
+		}
+	}
+	return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+}
+
+bool
+pair_cache::write(std::ostream& out, hist_geometry geometry) const
+{
+	write_value(out, cache_file_magic);
+	write_value(out, cache_file_version);
+	write_value(out, static_cast<std::uint32_t> (hist_geometry_bin_count(geometry)));
+	write_value(out, static_cast<std::uint64_t> (new_cliques_.size()));
+	for (auto const& c : new_cliques_)
+	{
+		write_value(out, c.threshold);
+		write_value(out, static_cast<std::uint64_t> (c.fingerprints.size()));
+		out.write(reinterpret_cast<char const*> (c.fingerprints.data()),
+				  c.fingerprints.size() * sizeof (std::uint64_t));
+	}
+	write_value(out, static_cast<std::uint64_t> (new_edges_.size()));
+	for (auto const& e : new_edges_)
+	{
+		write_value(out, e.a);
+		write_value(out, e.b);
+		write_value(out, e.distance);
+	}
+	return static_cast<bool> (out);
+}
+
+std::uint32_t
+pair_cache::clique_of(std::uint64_t fingerprint, double threshold) const
+{
+	auto found = clique_of_.find(fingerprint);
+	if (found == clique_of_.end() || thresholds_[found->second - 1] < threshold)
+	{
+		return 0;
+	}
+	return found->second;
+}
+
+void
+pair_cache::visit_matches(double threshold, edge_visitor const& visit) const
+{
+	for (auto const& e : edges_)
+	{
+		if (e.distance <= threshold)
+		{
+			visit(e.a, e.b, e.distance);
+		}
+	}
+}
+
+void
+pair_cache::add_clique(double threshold, std::vector<std::uint64_t> fingerprints)
+{
+	new_cliques_.push_back(clique{threshold, std::move(fingerprints)});
+}
+
+void
+pair_cache::add_match(std::uint64_t a, std::uint64_t b, double distance)
+{
+	if (new_pairs_.insert(pair_key(a, b)).second)
+	{
+		new_edges_.push_back(edge{a, b, distance});
+	}
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef PAIR_CACHE_H
+#define PAIR_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "image_hist.h"
+
+/*
+ * Remembers which pairs of images have been compared, across runs. Images
+ * are identified by their histogram fingerprints, so a file that is renamed
+ * keeps its pairs, and one that changes loses them.
+ * 
+ * Every join a run does is saved as a clique: the fingerprints of the 
+ * images that were compared with each other, and the match threshold they
+ * were compared at. Along with it goes the exact distance of every pair in 
+ * the clique that matched. Any other pair of the clique's images is known
+ * to be further apart than the clique's threshold, so a later run at the
+ * same or a tighter threshold doesn't need to compare them again.
+ */
+class pair_cache
+{
+public:
+
+	using edge_visitor = 
+			std::function<void(std::uint64_t a, std::uint64_t b, double distance)>;
+
+	pair_cache();
+
+	bool load(std::string const& filename, hist_geometry geometry);
+
+	/*
+	 * Saves the cliques and matches added in this run, replacing whatever
+	 * was loaded.
+	 */
+	bool save(std::string const& filename, hist_geometry geometry) const;
+
+	/*
+	 * The same, for a cache embedded in another file.
+	 */
+	bool read(std::istream& in, hist_geometry geometry);
+
+	bool write(std::ostream& out, hist_geometry geometry) const;
+
+	inline bool
+	is_loaded() const
+	{
+		return !thresholds_.empty();
+	}
+
+	/*
+	 * Returns the number (starting at 1) of a loaded clique containing 
+	 * fingerprint whose threshold is at least threshold, or 0 if there 
+	 * isn't one.
+	 */
+	std::uint32_t clique_of(std::uint64_t fingerprint, double threshold) const;
+
+	/*
+	 * Calls visit for every loaded match whose distance is at most 
+	 * threshold. Each pair of fingerprints is visited once, however many 
+	 * times it was saved.
+	 */
+	void visit_matches(double threshold, edge_visitor const& visit) const;
+
+	void add_clique(double threshold, std::vector<std::uint64_t> fingerprints);
+
+	/*
+	 * Adds a match to save, unless the pair was already added.
+	 */
+	void add_match(std::uint64_t a, std::uint64_t b, double distance);
+
+private:
+
+	struct pair_hash
+	{
+		inline std::size_t
+		operator()(std::pair<std::uint64_t, std::uint64_t> const& p) const
+		{
+			/* fingerprints are hashes already */
+			return static_cast<std::size_t> (p.first ^ (p.second * 0x9e3779b97f4a7c15ull));
+		}
+	};
+
+	using pair_set = std::unordered_set<std::pair<std::uint64_t, std::uint64_t>, pair_hash>;
+
+	static inline std::pair<std::uint64_t, std::uint64_t>
+	pair_key(std::uint64_t a, std::uint64_t b)
+	{
+		return a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+	}
+
+	struct edge
+	{
+		std::uint64_t a;
+		std::uint64_t b;
+		double distance;
+	};
+
+	struct clique
+	{
+		double threshold;
+		std::vector<std::uint64_t> fingerprints;
+	};
+
+	std::vector<double> thresholds_;
+	std::unordered_map<std::uint64_t, std::uint32_t> clique_of_;
+	std::vector<edge> edges_;
+	std::vector<clique> new_cliques_;
+	std::vector<edge> new_edges_;
+	pair_set new_pairs_;
+};
+
+#endif /* PAIR_CACHE_H */
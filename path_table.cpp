@@ -0,0 +1,108 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include <cstring>
+#include <boost/functional/hash.hpp>
+#include "path_table.h"
+
+path_table::path_table()
+:
+dirs_{},
+dir_ids_{},
+names_{},
+entries_{},
+ids_{0, id_hash{this}, id_equals{this}}
+{
+}
+
+std::size_t
+path_table::id_hash::operator()(image_id id) const
+{
+	auto const& e = table->entries_[id];
+	std::size_t seed = boost::hash_range(table->name_data(id), 
+										 table->name_data(id) + e.name_length);
+	boost::hash_combine(seed, e.dir);
+	return seed;
+}
+
+bool
+path_table::id_equals::operator()(image_id a, image_id b) const
+{
+	auto const& ea = table->entries_[a];
+	auto const& eb = table->entries_[b];
+	return ea.dir == eb.dir && ea.name_length == eb.name_length
+			&& std::memcmp(table->name_data(a), table->name_data(b), 
+						   ea.name_length) == 0;
+}
+
+bool
+path_table::insert(fs::path const& p, image_id& id)
+{
+	fs::path dir = p.parent_path();
+	std::string name = p.filename().string();
+
+	auto dir_result = dir_ids_.emplace(dir.string(), 
+									   static_cast<std::uint32_t> (dirs_.size()));
+	if (dir_result.second)
+	{
+		dirs_.push_back(dir);
+	}
+
+	/*
+	 * append the name tentatively, so that the lookup can hash and compare 
+	 * it like any other entry, and take it back out if it's already there
+	 */
+	id = static_cast<image_id> (entries_.size());
+	entries_.push_back(entry{names_.size(), 
+							 static_cast<std::uint32_t> (name.size()), 
+							 dir_result.first->second});
+	names_.append(name);
+
+	auto found = ids_.find(id);
+	if (found != ids_.end())
+	{
+		names_.resize(entries_.back().name_offset);
+		entries_.pop_back();
+		id = *found;
+		return false;
+	}
+	ids_.insert(id);
+	return true;
+}
+
+fs::path
+path_table::path(image_id id) const
+{
+	fs::path result(directory(id));
+	result /= filename(id);
+	return result;
+}
+
+bool
+path_table::less(image_id a, image_id b) const
+{
+	if (entries_[a].dir == entries_[b].dir)
+	{
+		return filename(a) < filename(b);
+	}
+	return path(a) < path(b);
+}
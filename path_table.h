@@ -0,0 +1,125 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef PATH_TABLE_H
+#define PATH_TABLE_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+#include "hist_store.h"
+
+namespace fs = boost::filesystem;
+
+/*
+ * Interns the paths of image files. Each directory is stored once, and file
+ * names are packed end to end in a single string arena, so a path costs an 
+ * entry of a few integers plus its file name. Paths are identified by dense
+ * ids, in the order they were first inserted; full paths are rebuilt only
+ * when they're asked for.
+ */
+class path_table
+{
+public:
+
+	path_table();
+
+	/* the id hasher and comparer point back at the table */
+	path_table(path_table const&) = delete;
+	path_table(path_table&&) = delete;
+	path_table& operator=(path_table const&) = delete;
+	path_table& operator=(path_table&&) = delete;
+
+	/*
+	 * Returns true if p wasn't already in the table. Either way, id is set
+	 * to the id of p.
+	 */
+	bool insert(fs::path const& p, image_id& id);
+
+	fs::path path(image_id id) const;
+
+	inline std::size_t
+	size() const
+	{
+		return entries_.size();
+	}
+
+	inline fs::path const&
+	directory(image_id id) const
+	{
+		return dirs_[entries_[id].dir];
+	}
+
+	inline std::string
+	filename(image_id id) const
+	{
+		return std::string(name_data(id), entries_[id].name_length);
+	}
+
+	/*
+	 * Orders ids by their full paths.
+	 */
+	bool less(image_id a, image_id b) const;
+
+private:
+
+	struct entry
+	{
+		std::uint64_t name_offset;
+		std::uint32_t name_length;
+		std::uint32_t dir;
+	};
+
+	struct id_hash
+	{
+		path_table const* table;
+
+		std::size_t operator()(image_id id) const;
+	};
+
+	struct id_equals
+	{
+		path_table const* table;
+
+		bool operator()(image_id a, image_id b) const;
+	};
+
+	inline char const*
+	name_data(image_id id) const
+	{
+		return names_.data() + entries_[id].name_offset;
+	}
+
+	std::vector<fs::path> dirs_;
+	std::unordered_map<std::string, std::uint32_t> dir_ids_;
+	std::string names_;
+	std::vector<entry> entries_;
+	std::unordered_set<image_id, id_hash, id_equals> ids_;
+};
+
+#endif /* PATH_TABLE_H */
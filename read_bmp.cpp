@@ -20,6 +20,11 @@
  * THE SOFTWARE.
  */
 
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include "image_info.h"
 #include "read_bmp.h"
 #include "bitmap_image.hpp"
 
@@ -36,3 +41,88 @@ bool read_bmp_file (std::string const& filename, bitmap_image& image)
 		return true;
 	}
 }
+
+namespace
+{
+
+template <class T>
+inline T
+read_le(unsigned char const* p)
+{
+	T value = 0;
+	for (auto i = 0u; i < sizeof (T); ++i)
+	{
+		value |= static_cast<T> (p[i]) << (8 * i);
+	}
+	return value;
+}
+
+constexpr std::size_t file_header_size = 14;
+constexpr std::size_t info_header_size = 40;
+
+} // namespace
+
+/*
+ * Accepts the same bitmaps as bitmap_image: uncompressed, 24 bits per pixel,
+ * with a BITMAPINFOHEADER, and no trailing data.
+ */
+bool read_bmp_buffer (unsigned char const* data, std::size_t size, bitmap_image& image)
+{
+	if (size < file_header_size + info_header_size
+		|| read_le<std::uint16_t> (data) != 19778
+		|| read_le<std::uint32_t> (data + file_header_size) != info_header_size
+		|| read_le<std::uint16_t> (data + file_header_size + 14) != 24)
+	{
+		return false;
+	}
+
+	/*
+	 * the header may be hostile; negative (top down) heights aren't
+	 * supported, and read as more than INT32_MAX
+	 */
+	std::uint32_t width = read_le<std::uint32_t> (data + file_header_size + 4);
+	std::uint32_t height = read_le<std::uint32_t> (data + file_header_size + 8);
+	if (width == 0 || height == 0 || width > INT32_MAX || height > INT32_MAX)
+	{
+		return false;
+	}
+	std::size_t padding = (4 - ((3 * static_cast<std::size_t> (width)) % 4)) % 4;
+	std::size_t row_size = 3 * static_cast<std::size_t> (width) + padding;
+	if (row_size > (SIZE_MAX - file_header_size - info_header_size) / height
+		|| size != file_header_size + info_header_size + row_size * height)
+	{
+		return false;
+	}
+
+	image.setwidth_height(width, height);
+	unsigned char const* p = data + file_header_size + info_header_size;
+	for (auto iy = 0u; iy < height; ++iy, p += row_size)
+	{
+		/* rows are stored bottom up, pixels as blue, green, red */
+		for (auto ix = 0u; ix < width; ++ix)
+		{
+			image.set_pixel(ix, height - iy - 1, p[3 * ix + 2], p[3 * ix + 1], p[3 * ix]);
+		}
+	}
+	return true;
+}
+
+bool probe_bmp_file (std::string const& filename, image_info& info)
+{
+	unsigned char header[file_header_size + info_header_size];
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.read(reinterpret_cast<char*> (header), sizeof (header))
+		|| read_le<std::uint16_t> (header) != 19778)
+	{
+		return false;
+	}
+
+	/* a negative height means the rows are stored top down */
+	info.format = "bmp";
+	info.width = read_le<std::uint32_t> (header + file_header_size + 4);
+	info.height = std::abs(static_cast<std::int32_t> (
+			read_le<std::uint32_t> (header + file_header_size + 8)));
+	info.bits_per_pixel = read_le<std::uint16_t> (header + file_header_size + 14);
+	info.color = info.bits_per_pixel <= 8 ? "palette" : "RGB";
+	return true;
+}
@@ -23,11 +23,20 @@
 #ifndef READ_BMP_H
 #define READ_BMP_H
 
+#include <cstddef>
 #include <string>
 
 class bitmap_image;
+struct image_info;
 
 bool read_bmp_file (std::string const& filename, bitmap_image& image);
 
+bool read_bmp_buffer (unsigned char const* data, std::size_t size, bitmap_image& image);
+
+/*
+ * Reads just enough of the file to fill in info.
+ */
+bool probe_bmp_file (std::string const& filename, image_info& info);
+
 #endif /* READ_BMP_H */
 
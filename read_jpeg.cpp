@@ -27,6 +27,8 @@
 #include <string>
 #include <assert.h>
 #include <jpeglib.h>
+#include "image_info.h"
+#include "read_jpeg.h"
 #include "bitmap_image.hpp"
 
 void put_rgb_scanline_in_image(JSAMPROW row_buffer, std::size_t row, std::size_t width, bitmap_image& image)
@@ -63,10 +65,12 @@ std::string color_space_name(J_COLOR_SPACE cs)
 		return std::string("CMYK");
 	case J_COLOR_SPACE::JCS_YCCK :
 		return std::string("YCCK");
+#if JPEG_LIB_VERSION >= 90
 	case J_COLOR_SPACE::JCS_BG_RGB :
 		return std::string("big gamut RGB/bg-sRGB");
 	case J_COLOR_SPACE::JCS_BG_YCC :
 		return std::string("big gamut YCC/bg-sYCC");
+#endif
 	default:
 		return "unknown color space value";
 	};
@@ -80,6 +84,7 @@ struct my_error_mgr
 {
 	struct jpeg_error_mgr pub;
 	jmp_buf setjmp_buffer;
+	std::string* message;
 };
 
 typedef struct my_error_mgr * my_error_ptr;
@@ -92,41 +97,65 @@ my_error_exit(j_common_ptr cinfo)
 	longjmp(myerr->setjmp_buffer, 1);
 }
 
+/*
+ * Keeps libjpeg's messages for the caller instead of printing them.
+ */
+METHODDEF(void)
+keep_message(j_common_ptr cinfo)
+{
+	char buffer[JMSG_LENGTH_MAX];
+	(*cinfo->err->format_message) (cinfo, buffer);
+	*((my_error_ptr) cinfo->err)->message = buffer;
+}
+
+/*
+ * Decodes from whatever source set_source gives the decompressor.
+ */
+template <class SetSource>
 bool
-read_jpeg_file(std::string const& filename, bitmap_image& image)
+decode_jpeg(SetSource set_source, bitmap_image& image, std::string* error)
 {
 	struct jpeg_decompress_struct cinfo;
 
 	struct my_error_mgr jerr;
 
-	FILE * infile; /* source file */
 	JSAMPARRAY buffer; /* Output row buffer */
 	int row_stride; /* physical row width in output buffer */
 
-	if ((infile = fopen(filename.c_str(), "rb")) == NULL)
-	{
-		fprintf(stderr, "can't open %s\n", filename.c_str());
-		return false;
-	}
-
 	cinfo.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = my_error_exit;
+	jerr.message = error;
+	if (error)
+	{
+		jerr.pub.output_message = keep_message;
+	}
 
 	if (setjmp(jerr.setjmp_buffer))
 	{
-		std::cerr << "in error handler" << std::endl;
+		if (!error)
+		{
+			std::cerr << "in error handler" << std::endl;
+		}
 		jpeg_destroy_decompress(&cinfo);
-		fclose(infile);
 		return false;
 	}
 
 	jpeg_create_decompress(&cinfo);
-	jpeg_stdio_src(&cinfo, infile);
+	set_source(&cinfo);
 	(void) jpeg_read_header(&cinfo, TRUE);
 	(void) jpeg_start_decompress(&cinfo);
 	if (cinfo.out_color_space != J_COLOR_SPACE::JCS_RGB && cinfo.out_color_space != J_COLOR_SPACE::JCS_GRAYSCALE)
 	{
-		std::cout << "unexpected color space: " << color_space_name(cinfo.out_color_space) << std::endl;
+		std::string message = "unexpected color space: " + color_space_name(cinfo.out_color_space);
+		if (error)
+		{
+			*error = message;
+		}
+		else
+		{
+			std::cout << message << std::endl;
+		}
+		jpeg_destroy_decompress(&cinfo);
 		return false;
 	}
 	row_stride = cinfo.output_width * cinfo.output_components;
@@ -149,7 +178,75 @@ read_jpeg_file(std::string const& filename, bitmap_image& image)
 
 	(void) jpeg_finish_decompress(&cinfo);
 	jpeg_destroy_decompress(&cinfo);
-	fclose(infile);
 	return true;
 }
 
+bool
+read_jpeg_file(std::string const& filename, bitmap_image& image)
+{
+	FILE * infile; /* source file */
+
+	if ((infile = fopen(filename.c_str(), "rb")) == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", filename.c_str());
+		return false;
+	}
+
+	bool result = decode_jpeg([infile](j_decompress_ptr cinfo)
+							  {
+								  jpeg_stdio_src(cinfo, infile);
+							  }, 
+							  image, nullptr);
+	fclose(infile);
+	return result;
+}
+
+bool
+read_jpeg_buffer(unsigned char const* data, 
+				 std::size_t size, 
+				 bitmap_image& image, 
+				 std::string* error)
+{
+	/* older versions of libjpeg don't take a const buffer */
+	return decode_jpeg([data, size](j_decompress_ptr cinfo)
+					   {
+						   jpeg_mem_src(cinfo, const_cast<unsigned char*> (data), 
+										static_cast<unsigned long> (size));
+					   }, 
+					   image, error);
+}
+
+bool
+probe_jpeg_file(std::string const& filename, image_info& info)
+{
+	FILE* infile = fopen(filename.c_str(), "rb");
+	if (infile == NULL)
+	{
+		return false;
+	}
+
+	struct jpeg_decompress_struct cinfo;
+	struct my_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = my_error_exit;
+	jerr.message = nullptr;
+	if (setjmp(jerr.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		fclose(infile);
+		return false;
+	}
+
+	/* the header ends at the start of the first scan */
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, infile);
+	(void) jpeg_read_header(&cinfo, TRUE);
+	info.format = "jpeg";
+	info.width = cinfo.image_width;
+	info.height = cinfo.image_height;
+	info.color = color_space_name(cinfo.jpeg_color_space);
+	info.bits_per_pixel = cinfo.data_precision * cinfo.num_components;
+	jpeg_destroy_decompress(&cinfo);
+	fclose(infile);
+	return true;
+}
@@ -23,11 +23,24 @@
 #ifndef READ_JPEG_H
 #define READ_JPEG_H
 
+#include <cstddef>
 #include <string>
 
 class bitmap_image;
+struct image_info;
 
 bool read_jpeg_file (std::string const& filename, bitmap_image& image);
 
+/*
+ * With error, messages are left there instead of being printed.
+ */
+bool read_jpeg_buffer (unsigned char const* data, std::size_t size, bitmap_image& image, 
+					   std::string* error = nullptr);
+
+/*
+ * Reads just enough of the file to fill in info.
+ */
+bool probe_jpeg_file (std::string const& filename, image_info& info);
+
 #endif /* READ_JPEG_H */
 
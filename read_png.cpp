@@ -20,14 +20,66 @@
  * THE SOFTWARE.
  */
 
+#include <fstream>
+#include <string>
+#include "image_info.h"
 #include "read_png.h"
 #include "lodepng.h"
 #include "bitmap_image.hpp"
 
-bool read_png_file (std::string const& filename, bitmap_image& image)
+namespace
+{
+
+/* the signature and the IHDR chunk, which holds the dimensions */
+constexpr std::size_t png_header_size = 33;
+
+std::string
+color_type_name(LodePNGColorType type)
 {
-	constexpr unsigned pixel_size = 4;
+	switch (type)
+	{
+	case LCT_GREY:
+		return "grey";
+	case LCT_RGB:
+		return "RGB";
+	case LCT_PALETTE:
+		return "palette";
+	case LCT_GREY_ALPHA:
+		return "grey with alpha";
+	case LCT_RGBA:
+		return "RGBA";
+	default:
+		return "unknown color type";
+	}
+}
+
+bool
+pixels_to_image(std::vector<unsigned char> const& pixels, 
+				unsigned width, unsigned height, 
+				bitmap_image& image)
+{
+	image.setwidth_height(width, height);
+
+	unsigned char const* p = pixels.data();
 	
+	for (auto iy = 0u; iy < height; ++iy)
+	{
+		for (auto ix = 0u; ix < width; ++ix)
+		{
+			unsigned char red = *p++;
+			unsigned char green = *p++;
+			unsigned char blue = *p++;
+			image.set_pixel(ix, iy, red, green, blue);
+			++p; // skip alpha channel byte
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+bool read_png_file (std::string const& filename, bitmap_image& image)
+{
 	std::vector<unsigned char> pixels; //the raw pixels
 	unsigned width, height;
 
@@ -43,20 +95,56 @@ bool read_png_file (std::string const& filename, bitmap_image& image)
 
 	//the pixels are now in the vector "image", 4 bytes per pixel, ordered RGBARGBA..., use it as texture, draw it, ...
 
-	image.setwidth_height(width, height);
+	return pixels_to_image(pixels, width, height, image);
+}
 
-	unsigned char *p = pixels.data();
-	
-	for (auto iy = 0u; iy < height; ++iy)
+bool read_png_buffer (unsigned char const* data, std::size_t size, bitmap_image& image, 
+					  std::string* error_message)
+{
+	std::vector<unsigned char> pixels;
+	unsigned width, height;
+
+	unsigned error = lodepng::decode(pixels, width, height, data, size);
+
+	if(error) 
 	{
-		for (auto ix = 0u; ix < width; ++ix)
+		std::string message = "PNG decoder error " + std::to_string(error) + ": " 
+				+ lodepng_error_text(error);
+		if (error_message)
 		{
-			unsigned char red = *p++;
-			unsigned char green = *p++;
-			unsigned char blue = *p++;
-			image.set_pixel(ix, iy, red, green, blue);
-			++p; // skip alpha channel byte
+			*error_message = message;
 		}
+		else
+		{
+			std::cout << message << std::endl;
+		}
+		return false;
 	}
-	return true;
+
+	return pixels_to_image(pixels, width, height, image);
+}
+
+bool probe_png_file (std::string const& filename, image_info& info)
+{
+	unsigned char header[png_header_size];
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.read(reinterpret_cast<char*> (header), sizeof (header)))
+	{
+		return false;
+	}
+
+	LodePNGState state;
+	lodepng_state_init(&state);
+	unsigned width, height;
+	unsigned error = lodepng_inspect(&width, &height, &state, header, sizeof (header));
+	if (!error)
+	{
+		info.format = "png";
+		info.width = width;
+		info.height = height;
+		info.color = color_type_name(state.info_png.color.colortype);
+		info.bits_per_pixel = lodepng_get_bpp(&state.info_png.color);
+	}
+	lodepng_state_cleanup(&state);
+	return !error;
 }
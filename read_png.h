@@ -23,11 +23,24 @@
 #ifndef READ_PNG_H
 #define READ_PNG_H
 
+#include <cstddef>
 #include <string>
 
 class bitmap_image;
+struct image_info;
 
 bool read_png_file (std::string const& filename, bitmap_image& image);
 
+/*
+ * With error, messages are left there instead of being printed.
+ */
+bool read_png_buffer (unsigned char const* data, std::size_t size, bitmap_image& image, 
+					  std::string* error = nullptr);
+
+/*
+ * Reads just enough of the file to fill in info.
+ */
+bool probe_png_file (std::string const& filename, image_info& info);
+
 #endif /* READ_PNG_H */
 
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#include <cstdio>
+#include "result_writer.h"
+
+namespace
+{
+
+constexpr std::size_t batch_records = 256;
+constexpr std::chrono::seconds batch_age{1};
+
+} // namespace
+
+bool
+parse_result_format(std::string const& name, result_format& format)
+{
+	if (name == "jsonl" || name == "ndjson")
+	{
+		format = result_format::jsonl;
+	}
+	else if (name == "csv")
+	{
+		format = result_format::csv;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+result_writer::result_writer()
+:
+format_{result_format::none},
+out_{},
+buffer_{},
+buffered_{0},
+has_threshold_{false},
+threshold_{0.0},
+last_flush_{}
+{
+	buffer_.precision(10);
+}
+
+result_writer::~result_writer()
+{
+	flush();
+}
+
+void
+result_writer::open(result_format format, std::streambuf* out)
+{
+	format_ = format;
+	out_.reset(new std::ostream(out));
+	if (format_ == result_format::csv)
+	{
+		buffer_ << "record,set,path,other,distance,threshold";
+		end_record();
+	}
+}
+
+void
+result_writer::write_string(std::string const& str)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << '"';
+		for (char c : str)
+		{
+			switch (c)
+			{
+			case '"':
+				buffer_ << "\\\"";
+				break;
+			case '\\':
+				buffer_ << "\\\\";
+				break;
+			case '\n':
+				buffer_ << "\\n";
+				break;
+			case '\r':
+				buffer_ << "\\r";
+				break;
+			case '\t':
+				buffer_ << "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char> (c) < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof (escaped), "\\u%04x", c);
+					buffer_ << escaped;
+				}
+				else
+				{
+					buffer_ << c;
+				}
+			}
+		}
+		buffer_ << '"';
+	}
+	else if (str.find_first_of(",\"\r\n") != std::string::npos)
+	{
+		buffer_ << '"';
+		for (char c : str)
+		{
+			if (c == '"')
+			{
+				buffer_ << '"';
+			}
+			buffer_ << c;
+		}
+		buffer_ << '"';
+	}
+	else
+	{
+		buffer_ << str;
+	}
+}
+
+void
+result_writer::write_match(fs::path const& a, fs::path const& b, double distance)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << "{\"type\":\"match\",\"a\":";
+		write_string(a.string());
+		buffer_ << ",\"b\":";
+		write_string(b.string());
+		buffer_ << ",\"distance\":" << distance << "}";
+	}
+	else
+	{
+		buffer_ << "match,,";
+		write_string(a.string());
+		buffer_ << ",";
+		write_string(b.string());
+		buffer_ << "," << distance << ",";
+	}
+	end_record();
+}
+
+void
+result_writer::write_nearest(fs::path const& target, 
+							 std::size_t rank, 
+							 fs::path const& match, 
+							 double distance)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << "{\"type\":\"nearest\",\"target\":";
+		write_string(target.string());
+		buffer_ << ",\"rank\":" << rank << ",\"path\":";
+		write_string(match.string());
+		buffer_ << ",\"distance\":" << distance << "}";
+	}
+	else
+	{
+		buffer_ << "nearest," << rank << ",";
+		write_string(match.string());
+		buffer_ << ",";
+		write_string(target.string());
+		buffer_ << "," << distance << ",";
+	}
+	end_record();
+}
+
+void
+result_writer::write_cluster(std::size_t set_index,
+							 std::vector<fs::path> const& members,
+							 std::vector<double> const& distances,
+							 std::size_t medoid)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << "{\"type\":\"cluster\",\"set\":" << set_index;
+		if (has_threshold_)
+		{
+			buffer_ << ",\"threshold\":" << threshold_;
+		}
+		buffer_ << ",\"medoid\":";
+		write_string(members[medoid].string());
+		buffer_ << ",\"members\":[";
+		for (auto i = 0ul; i < members.size(); ++i)
+		{
+			buffer_ << (i > 0 ? ",{\"path\":" : "{\"path\":");
+			write_string(members[i].string());
+			buffer_ << ",\"distance\":" << distances[i] << "}";
+		}
+		buffer_ << "]}";
+		end_record();
+	}
+	else
+	{
+		for (auto i = 0ul; i < members.size(); ++i)
+		{
+			buffer_ << "member," << set_index << ",";
+			write_string(members[i].string());
+			buffer_ << ",";
+			write_string(members[medoid].string());
+			buffer_ << "," << distances[i] << ",";
+			if (has_threshold_)
+			{
+				buffer_ << threshold_;
+			}
+			end_record();
+		}
+	}
+}
+
+void
+result_writer::write_aliases(fs::path const& file, 
+							 std::vector<fs::path> const& aliases)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << "{\"type\":\"aliases\",\"path\":";
+		write_string(file.string());
+		buffer_ << ",\"aliases\":[";
+		for (auto i = 0ul; i < aliases.size(); ++i)
+		{
+			buffer_ << (i > 0 ? "," : "");
+			write_string(aliases[i].string());
+		}
+		buffer_ << "]}";
+		end_record();
+	}
+	else
+	{
+		for (auto const& alias : aliases)
+		{
+			buffer_ << "alias,,";
+			write_string(alias.string());
+			buffer_ << ",";
+			write_string(file.string());
+			buffer_ << ",,";
+			end_record();
+		}
+	}
+}
+
+void
+result_writer::write_summary(std::size_t set_count, std::size_t file_count)
+{
+	if (format_ == result_format::jsonl)
+	{
+		buffer_ << "{\"type\":\"summary\",";
+		if (has_threshold_)
+		{
+			buffer_ << "\"threshold\":" << threshold_ << ",";
+		}
+		buffer_ << "\"sets\":" << set_count << ",\"files\":" << file_count << "}";
+		end_record();
+	}
+	else if (format_ == result_format::csv)
+	{
+		buffer_ << "summary," << set_count << "," << file_count << ",,,";
+		if (has_threshold_)
+		{
+			buffer_ << threshold_;
+		}
+		end_record();
+	}
+	flush();
+}
+
+void
+result_writer::set_threshold(double threshold)
+{
+	has_threshold_ = true;
+	threshold_ = threshold;
+}
+
+void
+result_writer::end_record()
+{
+	buffer_ << '\n';
+	if (++buffered_ >= batch_records 
+		|| std::chrono::steady_clock::now() - last_flush_ >= batch_age)
+	{
+		flush();
+	}
+}
+
+void
+result_writer::poll()
+{
+	if (buffered_ > 0 
+		&& std::chrono::steady_clock::now() - last_flush_ >= batch_age)
+	{
+		flush();
+	}
+}
+
+void
+result_writer::flush()
+{
+	if (!out_ || buffered_ == 0)
+	{
+		return;
+	}
+	*out_ << buffer_.str();
+	out_->flush();
+	buffer_.str(std::string{});
+	buffered_ = 0;
+	last_flush_ = std::chrono::steady_clock::now();
+}
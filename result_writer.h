@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017 David Curtis
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy 
+ * of this software and associated documentation files (the "Software"), to 
+ * deal in the Software without restriction, including without limitation the 
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or 
+ * sell copies of the Software, and to permit persons to whom the Software is 
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in 
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN 
+ * THE SOFTWARE.
+ */
+
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "boost/filesystem/path.hpp"
+
+namespace fs = boost::filesystem;
+
+enum class result_format
+{
+	none,
+	jsonl,
+	csv
+};
+
+/*
+ * Accepts "jsonl", "ndjson" (the same format) and "csv".
+ */
+bool parse_result_format(std::string const& name, result_format& format);
+
+/*
+ * Streams match results as they're found, one record per line. Records are
+ * collected in a buffer that is written out every few hundred records, or 
+ * with the first record after a second has passed since the last write, so 
+ * a consumer reading from a pipe sees results while the search is still 
+ * running without paying for a write per record.
+ * 
+ * JSON Lines records have a "type" of "match" (a pair of matching images),
+ * "nearest" (an entry in a target's ranked list), "cluster" (a match set, 
+ * with each member's distance from the set's medoid), "aliases" (paths to
+ * a file that was already found) or "summary". CSV
+ * records have the columns record,set,path,other,distance,threshold; the 
+ * summary row has the number of sets in the set column, and the number of
+ * files in the path column.
+ */
+class result_writer
+{
+public:
+
+	result_writer();
+
+	~result_writer();
+
+	void open(result_format format, std::streambuf* out);
+
+	inline bool
+	is_open() const
+	{
+		return format_ != result_format::none;
+	}
+
+	void write_match(fs::path const& a, fs::path const& b, double distance);
+
+	void write_nearest(fs::path const& target, 
+					   std::size_t rank, 
+					   fs::path const& match, 
+					   double distance);
+
+	void write_cluster(std::size_t set_index,
+					   std::vector<fs::path> const& members,
+					   std::vector<double> const& distances,
+					   std::size_t medoid);
+
+	/*
+	 * Other paths to the same file, through hard links or bind mounts.
+	 */
+	void write_aliases(fs::path const& file, std::vector<fs::path> const& aliases);
+
+	void write_summary(std::size_t set_count, std::size_t file_count);
+
+	/*
+	 * When several thresholds are swept, cluster and summary records are
+	 * labeled with the threshold they were found at.
+	 */
+	void set_threshold(double threshold);
+
+	void flush();
+
+	/*
+	 * Writes out records that have waited longer than the batch age, for 
+	 * when no record may follow them for a long while.
+	 */
+	void poll();
+
+private:
+
+	void end_record();
+
+	void write_string(std::string const& str);
+
+	result_format format_;
+	std::unique_ptr<std::ostream> out_;
+	std::ostringstream buffer_;
+	std::size_t buffered_;
+	bool has_threshold_;
+	double threshold_;
+	std::chrono::steady_clock::time_point last_flush_;
+};
+
+#endif /* RESULT_WRITER_H */